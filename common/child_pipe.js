@@ -4,18 +4,36 @@ const async = require('async');
 const path = require('path');
 const child_process = require('child_process');
 const events = require('events');
+const fs = require('fs');
+const os = require('os');
 const logio = require('../common/logio');
+const pipe_frames = require('./pipe_frames');
 
 exports.ChildJsonPipe = ChildJsonPipe;
 exports.sshify = sshify;
 
+/*
+  Options:
+    nChildren: how many copies of the child to run. rpc picks the least busy one.
+    maxInFlight: how many calls each child can have outstanding. More wait in a queue shared
+      by all the children, and go to whichever child finishes a call first. So one slow call
+      doesn't hold up calls that another child could be running. Default unlimited.
+    shareMem: true, or a size in bytes (default 64 MB), to pass typed arrays in params and
+      results through a file in /dev/shm instead of as JSON text. Only for C++ children
+      using ParentJsonPipe (see parent_pipe.h), and not with sshHost.
+    shareMemMin: smallest typed array (in bytes) to pass that way, default 4096.
+    framing: 'boxed' to send length-prefixed frames instead of lines, with typed arrays of at
+      least shareMemMin bytes in a binary attachment (see pipe_frames.js). The children
+      must support it: ParentJsonPipe in parent_pipe.js or parent_pipe.h, or StdioServer in
+      parent_pipe.py. With shareMem too, arrays go through shared memory instead.
+*/
 function ChildJsonPipe(execName, execArgs, execOptions, o) {
-  if (o.shareMem) {
-    // WRITEME: create a SHM or shared mmapped file with the child, for passing large
-    // numerical arrays around.
-  }
   this.baseName = o.baseName || execName;
+  this.framing = o.framing || 'lines';
+  this.frameMinBytes = o.shareMemMin || 4096;
+  if (this.framing !== 'lines' && this.framing !== 'boxed') throw new Error(`Unknown framing ${this.framing}`);
   if (o.sshHost) {
+    if (this.framing !== 'lines') execName = `TLBCORE_PIPE_FRAMING=${this.framing} ${execName}`;
     execArgs = sshify(execName, execArgs, o.sshHost);
     execName = 'ssh';
     this.baseName = o.sshHost + '$' + this.baseName;
@@ -24,44 +42,74 @@ function ChildJsonPipe(execName, execArgs, execOptions, o) {
   this.verbose = o.verbose || 0;
   let nChildren = o.nChildren || 1;
 
-  this.children = _.map(_.range(nChildren), () => {
+  this.shms = _.map(_.range(nChildren), (childi) => {
+    if (!o.shareMem || o.sshHost) return null;
+    return new ShmFile(childi, o.shareMem === true ? 64*1024*1024 : o.shareMem, o.shareMemMin || 4096);
+  });
+  this.children = _.map(_.range(nChildren), (childi) => {
+    let childEnv = {};
+    if (this.shms[childi]) childEnv.TLBCORE_SHM = this.shms[childi].fn;
+    if (this.framing !== 'lines' && !o.sshHost) childEnv.TLBCORE_PIPE_FRAMING = this.framing;
+    let childOptions = execOptions;
+    if (!_.isEmpty(childEnv)) {
+      childOptions = _.assign({}, execOptions, {
+        env: _.assign({}, execOptions.env || process.env, childEnv),
+      });
+    }
     return child_process.spawn(execName, execArgs, _.assign({stdio: [
       'pipe',
       'pipe',
       o.captureStderr ? 'pipe' : 'inherit'
-    ]}, execOptions));
+    ]}, childOptions));
   });
-  this.queues = _.map(_.range(this.children.length), () => {
-    return [];
+  // Outstanding calls on each child, by id
+  this.inFlight = _.map(_.range(this.children.length), () => {
+    return new Map();
   });
+  this.maxInFlight = o.maxInFlight || Infinity;
+  // Calls waiting for a child, when they're all at maxInFlight
+  this.pending = [];
+  this.pendingHead = 0;
+  this.latencyStats = {};
   this.logs = [];
   this.rpcIdCtr = Math.floor(Math.random()*1000000000);
   _.each(_.range(this.children.length), (childi) => {
-    let datas=[];
-    this.children[childi].stdout.on('data', (buf) => {
-      while (buf.length) {
-        let eol = buf.indexOf(10); // newline
-        if (eol < 0) {
-          datas.push(buf);
-          return;
-        } else {
-          datas.push(buf.slice(0, eol));
-          let rep;
-          try {
-            rep = JSON.parse(datas.join(''));
-          }
-          catch(ex) {
-            console.log('Error parsing', datas.join(''));
+    if (this.framing === 'boxed') {
+      let shm = this.shms[childi];
+      let reader = new pipe_frames.FrameReader((rep) => {
+        this.handleRx(childi, rep);
+      }, shm ? ((text) => shm.parse(text)) : null);
+      this.children[childi].stdout.on('data', (buf) => {
+        reader.push(buf);
+      });
+    }
+    else {
+      let datas=[];
+      this.children[childi].stdout.on('data', (buf) => {
+        while (buf.length) {
+          let eol = buf.indexOf(10); // newline
+          if (eol < 0) {
+            datas.push(buf);
+            return;
+          } else {
+            datas.push(buf.slice(0, eol));
+            let rep;
+            try {
+              rep = this.shms[childi] ? this.shms[childi].parse(datas.join('')) : JSON.parse(datas.join(''));
+            }
+            catch(ex) {
+              console.log('Error parsing', datas.join(''));
+              datas = [];
+              buf = buf.slice(eol+1);
+              continue; // eslint-disable-line no-continue
+            }
             datas = [];
+            this.handleRx(childi, rep);
             buf = buf.slice(eol+1);
-            continue; // eslint-disable-line no-continue
           }
-          datas = [];
-          this.handleRx(childi, rep);
-          buf = buf.slice(eol+1);
         }
-      }
-    });
+      });
+    }
     if (o.captureStderr) {
       this.children[childi].stderr.on('data', (d) => {
         this.logs.push(d);
@@ -87,18 +135,18 @@ ChildJsonPipe.prototype = Object.create(events.EventEmitter.prototype);
 
 ChildJsonPipe.prototype.close = function() {
   for (let childi=0; childi<this.children.length; childi++) {
-    this.children[childi].stdin.end();
+    if (this.children[childi]) this.children[childi].stdin.end();
   }
   this.emit('close');
 };
 
-// Return index of child with shortest outstanding queue length
+// Return index of running child with fewest outstanding calls, or -1 if none are running
 ChildJsonPipe.prototype.chooseAvailChild = function() {
-  let bestLen = this.queues[0].length;
-  let besti = 0;
-  for (let childi=1; childi<this.children.length; childi++) {
-    if (this.queues[childi].length < bestLen) {
-      bestLen = this.queues[childi].length;
+  let bestLen = Infinity;
+  let besti = -1;
+  for (let childi=0; childi<this.children.length; childi++) {
+    if (this.children[childi] && this.inFlight[childi].size < bestLen) {
+      bestLen = this.inFlight[childi].size;
       besti = childi;
     }
   }
@@ -106,41 +154,48 @@ ChildJsonPipe.prototype.chooseAvailChild = function() {
 };
 
 ChildJsonPipe.prototype.tx = function(childi, req) {
-  this.children[childi].stdin.write(JSON.stringify(req));
-  this.children[childi].stdin.write('\n');
+  let shm = this.shms[childi];
+  let stdin = this.children[childi].stdin;
+  if (this.framing === 'boxed') {
+    let frame = shm ? pipe_frames.frameText(shm.stringify(req), [], 0) : pipe_frames.encodeFrame(req, this.frameMinBytes);
+    for (let buf of frame) stdin.write(buf);
+  }
+  else {
+    stdin.write(shm ? shm.stringify(req) : JSON.stringify(req));
+    stdin.write('\n');
+  }
 };
 
 ChildJsonPipe.prototype.handleRx = function(childi, rx) {
-  let q = this.queues[childi];
-  let repInfo = null;
-  if (rx.result || rx.error) {
-    for (let qi=0; qi<q.length; qi++) {
-      if (q[qi].id === rx.id) {
-        repInfo = q[qi];
-        if (!(rx.error && rx.error === 'progress')) {
-          q.splice(qi, 1);
-        }
-      }
+  let shm = this.shms[childi];
+  if (shm && rx.id !== undefined && rx.error !== 'progress') {
+    shm.finishCall(rx.id);
+  }
+  if (rx.cmd === 'emit') {
+    this.emit(...rx.params);
+  }
+  else if (rx.id !== undefined) {
+    let repInfo = this.inFlight[childi].get(rx.id);
+    if (!repInfo) {
+      logio.E(this.baseName + childi.toString(), 'Unknown id', rx);
     }
-    if (repInfo) {
-      if (rx.error && rx.error === 'progress') {
-        if (this.verbose>=2) logio.E(this.baseName + childi.toString(), 'rx', repInfo.method, 'progress', Date.now()-repInfo.t0);
-        repInfo.cb('progress', rx.result);
-      }
-      else if (rx.error) {
+    else if (rx.error === 'progress') {
+      if (this.verbose>=2) logio.E(this.baseName + childi.toString(), 'rx', repInfo.method, 'progress', Date.now()-repInfo.t0);
+      repInfo.cb('progress', rx.result);
+    }
+    else {
+      this.inFlight[childi].delete(rx.id);
+      this.recordLatency(repInfo);
+      if (rx.error) {
         if (this.verbose>=1) logio.E(this.baseName + childi.toString(), 'rx', repInfo.method, rx.error, Date.now()-repInfo.t0);
         repInfo.cb(rx.error instanceof Error ? rx.error : new Error(rx.error), rx.result);
       } else {
         if (this.verbose>=2) logio.I(this.baseName + childi.toString(), repInfo.method, Date.now()-repInfo.t0);
         repInfo.cb(null, rx.result);
       }
-    } else {
-      logio.E(this.baseName + childi.toString(), 'Unknown id', rx);
+      this.startPending(childi);
     }
   }
-  else if (rx.cmd === 'emit') {
-    this.emit(...rx.params);
-  }
   else {
     logio.E(this.baseName + childi.toString(), 'Unknown message', rx);
   }
@@ -150,32 +205,215 @@ ChildJsonPipe.prototype.handleRx = function(childi, rx) {
 ChildJsonPipe.prototype.rpc = function(method, params, cb) {
   let childi = this.chooseAvailChild();
   if (cb) {
-    let id = this.rpcIdCtr++;
-    this.queues[childi].push({id: id, cb: cb, method: method, t0: Date.now()});
-    this.tx(childi, {method: method, params: params, id: id});
+    let repInfo = {id: this.rpcIdCtr++, cb: cb, method: method, params: params, tQueued: Date.now(), t0: 0};
+    if (childi < 0) {
+      return cb('closed', null);
+    }
+    if (this.inFlight[childi].size >= this.maxInFlight) {
+      this.pending.push(repInfo);
+      return;
+    }
+    this.startCall(childi, repInfo);
   }
-  else {
+  else if (childi >= 0) {
     this.tx(childi, {method: method, params: params});
   }
 };
 
+ChildJsonPipe.prototype.startCall = function(childi, repInfo) {
+  repInfo.t0 = Date.now();
+  this.inFlight[childi].set(repInfo.id, repInfo);
+  let params = repInfo.params;
+  repInfo.params = null;
+  this.tx(childi, {method: repInfo.method, params: params, id: repInfo.id});
+};
+
+// When childi has room, give it the oldest waiting calls
+ChildJsonPipe.prototype.startPending = function(childi) {
+  while (this.pendingHead < this.pending.length && this.children[childi] && this.inFlight[childi].size < this.maxInFlight) {
+    let repInfo = this.pending[this.pendingHead];
+    this.pending[this.pendingHead++] = undefined;
+    this.startCall(childi, repInfo);
+  }
+  if (this.pendingHead === this.pending.length) {
+    this.pending = [];
+    this.pendingHead = 0;
+  }
+  else if (this.pendingHead > 1024 && this.pendingHead * 2 > this.pending.length) {
+    this.pending = this.pending.slice(this.pendingHead);
+    this.pendingHead = 0;
+  }
+};
+
+/*
+  Per-method latency histograms of total time, waiting plus running in the child. Bucket 0
+  counts calls under 1 ms, and bucket i those from 2^(i-1) to 2^i ms.
+*/
+ChildJsonPipe.prototype.recordLatency = function(repInfo) {
+  let now = Date.now();
+  let stats = this.latencyStats[repInfo.method];
+  if (!stats) {
+    stats = this.latencyStats[repInfo.method] = {count: 0, totalMs: 0, waitMs: 0, maxMs: 0, buckets: new Array(24).fill(0)};
+  }
+  let ms = now - repInfo.tQueued;
+  stats.count++;
+  stats.totalMs += ms;
+  stats.waitMs += repInfo.t0 - repInfo.tQueued;
+  stats.maxMs = Math.max(stats.maxMs, ms);
+  let bucket = ms < 1 ? 0 : Math.min(stats.buckets.length - 1, Math.floor(Math.log2(ms)) + 1);
+  stats.buckets[bucket]++;
+};
+
+/*
+  Summary of latencyStats: {method: {count, meanMs, meanWaitMs, maxMs, p50Ms, p90Ms, p99Ms}}.
+  Percentiles are the upper bounds of their histogram buckets.
+*/
+ChildJsonPipe.prototype.getLatencySummary = function() {
+  return _.mapValues(this.latencyStats, (stats) => {
+    let pctMs = (frac) => {
+      let todo = frac * stats.count;
+      for (let i = 0; i < stats.buckets.length; i++) {
+        todo -= stats.buckets[i];
+        if (todo <= 0) return Math.min(stats.maxMs, Math.pow(2, i));
+      }
+      return stats.maxMs;
+    };
+    return {
+      count: stats.count,
+      meanMs: stats.totalMs / stats.count,
+      meanWaitMs: stats.waitMs / stats.count,
+      maxMs: stats.maxMs,
+      p50Ms: pctMs(0.5),
+      p90Ms: pctMs(0.9),
+      p99Ms: pctMs(0.99),
+    };
+  });
+};
+
 // Do initial interaction with all the children
 ChildJsonPipe.prototype.handshake = function(cb) {
   async.each(_.range(this.children.length), (childi, childDone) => {
-    let method = 'handshake';
-    let params = [];
-    let id = this.rpcIdCtr++;
-    this.queues[childi].push({id: id, cb: childDone, method: method, t0: Date.now()});
-    this.tx(childi, {method: method, params: params, id: id});
+    this.startCall(childi, {id: this.rpcIdCtr++, cb: childDone, method: 'handshake', params: [], tQueued: Date.now(), t0: 0});
   }, cb);
 };
 
 ChildJsonPipe.prototype.handleClose = function(childi) {
   this.children[childi] = null;
-  while (this.queues[childi].length > 0) {
-    let repInfo = this.queues[childi].shift();
+  if (this.shms[childi]) {
+    this.shms[childi].close();
+    this.shms[childi] = null;
+  }
+  let inFlight = this.inFlight[childi];
+  this.inFlight[childi] = new Map();
+  for (let repInfo of inFlight.values()) {
     repInfo.cb('closed', null);
   }
+  // Waiting calls go to the remaining children, or fail if there are none
+  if (this.chooseAvailChild() < 0) {
+    let pending = this.pending.slice(this.pendingHead);
+    this.pending = [];
+    this.pendingHead = 0;
+    for (let repInfo of pending) {
+      repInfo.cb('closed', null);
+    }
+  }
+};
+
+
+/*
+  The parent side of a ShmFile (see chunk_file.h). The first half of the file carries arrays in
+  requests to the child, allocated in a ring by call id and released when the response comes.
+  The second half carries arrays in responses, allocated by the child. After reading a response
+  we tell the child it can reuse that space with shmAck on the next request.
+  Node can't mmap, so we copy arrays in and out with pwrite and pread. That's still much cheaper
+  than formatting and parsing numbers.
+*/
+function ShmFile(childi, size, minBytes) {
+  let dir = fs.existsSync('/dev/shm') ? '/dev/shm' : os.tmpdir();
+  this.fn = path.join(dir, `tlbcore-${process.pid}-${Math.floor(Math.random()*1000000000)}-${childi}`);
+  this.fd = fs.openSync(this.fn, 'w+', 0o600);
+  fs.ftruncateSync(this.fd, size);
+  this.size = size;
+  this.minBytes = minBytes;
+  // Same split as ShmFile in chunk_file.cc
+  this.down = new ShmRing(0, Math.floor(size / 16) * 8);
+  this.acks = [];
+}
+
+/*
+  JSON.stringify, with big typed arrays replaced by ndarrays in shared memory. Requests without
+  an id never get a response to release their space, so they're all text.
+*/
+ShmFile.prototype.stringify = function(req) {
+  if (this.acks.length) {
+    req.shmAck = this.acks;
+    this.acks = [];
+  }
+  if (req.id === undefined) return JSON.stringify(req);
+  return pipe_frames.stringifyWithNdarrays(req, this.minBytes, (arr) => {
+    let partOfs = this.down.alloc(arr.byteLength, req.id);
+    if (partOfs >= 0) {
+      fs.writeSync(this.fd, new Uint8Array(arr.buffer, arr.byteOffset, arr.byteLength), 0, arr.byteLength, partOfs);
+    }
+    return partOfs;
+  });
+};
+
+// JSON.parse, with ndarrays in shared memory read into typed arrays
+ShmFile.prototype.parse = function(text) {
+  return pipe_frames.parseWithNdarrays(text, (partOfs, partBytes) => {
+    if (partOfs + partBytes > this.size) return null;
+    let ret = new Uint8Array(partBytes);
+    fs.readSync(this.fd, ret, 0, partBytes, partOfs);
+    return ret;
+  });
+};
+
+// After the final response to call id, neither side needs its arrays
+ShmFile.prototype.finishCall = function(id) {
+  this.down.release(id);
+  this.acks.push(id);
+};
+
+ShmFile.prototype.close = function() {
+  fs.closeSync(this.fd);
+  fs.unlinkSync(this.fn);
+};
+
+/*
+  Same as ShmRing in chunk_file.h
+*/
+function ShmRing(base, size) {
+  this.base = base;
+  this.size = size;
+  this.head = 0;
+  this.tail = 0;
+  this.allocs = [];
+}
+
+// Return file offset of n bytes tagged with tag, or -1 if there's no room
+ShmRing.prototype.alloc = function(n, tag) {
+  n = Math.ceil(n / 8) * 8;
+  if (n > this.size) return -1;
+  let pos = this.head;
+  let ofs = pos % this.size;
+  if (ofs + n > this.size) {
+    pos += this.size - ofs;
+    ofs = 0;
+  }
+  if (pos + n - this.tail > this.size) return -1;
+  this.head = pos + n;
+  this.allocs.push({tag, end: this.head, freed: false});
+  return this.base + ofs;
+};
+
+ShmRing.prototype.release = function(tag) {
+  for (let a of this.allocs) {
+    if (a.tag === tag) a.freed = true;
+  }
+  while (this.allocs.length && this.allocs[0].freed) {
+    this.tail = this.allocs.shift().end;
+  }
 };
 
 /*
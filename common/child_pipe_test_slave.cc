@@ -0,0 +1,54 @@
+/*
+  A C++ child for test_child_pipe.js, like child_pipe_test_slave.js and .py, using ParentJsonPipe.
+  The test runs it only if it's been built.
+
+  Compile with (from the directory containing tlbcore, after building build.src):
+  $ g++ -std=c++14 -O2 -I. -Itlbcore -o tlbcore/build.src/child_pipe_test_slave tlbcore/common/child_pipe_test_slave.cc tlbcore/common/parent_pipe.cc tlbcore/common/uv_wrappers.cc tlbcore/common/jsonio.cc tlbcore/common/jsonio_parse.cc tlbcore/common/jsonio_types.cc tlbcore/common/ndarray_encoding.cc tlbcore/common/compress_parallel.cc tlbcore/common/parengine.cc tlbcore/common/chunk_file.cc tlbcore/common/hacks.cc -larmadillo -luv -lz -lpthread
+*/
+#include "tlbcore/common/std_headers.h"
+#include "./parent_pipe.h"
+
+static double test1(ParentJsonPipeCall &call, double v)
+{
+  return v + 1;
+}
+
+int main(int argc, char **argv)
+{
+  ParentJsonPipe pp(uv_default_loop());
+
+  // A function pointer
+  pp.addMethod("test1", &test1);
+
+  pp.addMethod("test2", [](ParentJsonPipeCall &call, string const &a, string const &b, jsonstr const &c) {
+    map< string, jsonstr > cMembers;
+    string err;
+    if (a != "abc" || b != "def" || !fromJson(c, cMembers, err) || cMembers["ghi"].it != "\"jkl\"") {
+      throw runtime_error("test2: wrong params");
+    }
+    return asJson(vector< jsonstr > {asJson(vector< jsonstr > {asJson(a), asJson(b), c}), asJson(string("foo"))});
+  });
+
+  pp.addMethod("testerr", [](ParentJsonPipeCall &call) -> double {
+    throw runtime_error("testerr always raises this error");
+  });
+
+  // Returns null
+  pp.addMethod("testvoid", [](ParentJsonPipeCall &call, double v) {
+    if (v < 0) throw runtime_error("testvoid: negative");
+  });
+
+  // A mutable lambda. Calls can overlap, so it needs a lock
+  pp.addMethod("testcount", [count = 0, countMutex = make_shared< mutex >()](ParentJsonPipeCall &call) mutable {
+    unique_lock< mutex > lock(*countMutex);
+    return (double)++count;
+  });
+
+  pp.addMethod("testfunc", std::function< string(ParentJsonPipeCall &, string const &) >(
+    [](ParentJsonPipeCall &call, string const &s) {
+      return s + s;
+    }));
+
+  pp.run();
+  return 0;
+}
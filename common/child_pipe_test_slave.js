@@ -16,6 +16,10 @@ function main() {
       assert.equal(c.ghi, 'jkl');
       cb(null, [[a, b, c], 'foo']);
     },
+    rpc_testarr: (a, cb) => {
+      assert.ok(a instanceof Float64Array);
+      cb(null, [a.map((x) => x * 2), a.length]);
+    },
     rpc_testerr: (cb) => {
       cb(new Error('testerr always raises this error'));
     },
@@ -1,5 +1,7 @@
 #include "tlbcore/common/std_headers.h"
 #include "./chunk_file.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 static size_t roundUp(size_t baseSize) {
@@ -85,17 +87,31 @@ ChunkFileCompressed::ChunkFileCompressed(string const &_fn)
   }
 }
 ChunkFileCompressed::~ChunkFileCompressed() {
+  close();
+}
+
+bool ChunkFileCompressed::close()
+{
+  std::unique_lock< std::mutex > lock(mutex);
   if (gzfp) {
     if (0) eprintf("Wrote %zd bytes to %s\n", off, fn.c_str());
-    gzclose(gzfp);
+    if (gzclose(gzfp) != Z_OK) {
+      eprintf("gzclose %s: failed\n", fn.c_str());
+      errFlag = true;
+    }
     gzfp = nullptr;
   }
+  return !errFlag;
 }
 
 off_t ChunkFileCompressed::writeChunk(char const *data, size_t size)
 {
   if (size == 0) return 0;
   std::unique_lock< std::mutex > lock(mutex);
+  if (!gzfp) {
+    errFlag = true;
+    return -1;
+  }
 
   off_t baseOff = off;
   off += (roundUp(size)+8);
@@ -257,3 +273,103 @@ size_t ChunkMemory::size()
 {
   return buf.size();
 }
+
+
+off_t ShmRing::alloc(size_t n, string const &tag)
+{
+  n = roundUp(n);
+  std::unique_lock< std::mutex > lock(mutex);
+  if (n > size) return -1;
+  U64 pos = head;
+  size_t ofs = (size_t)(pos % size);
+  if (ofs + n > size) {
+    // Doesn't fit before the end, so skip to the start. The skipped space is freed with this allocation
+    pos += size - ofs;
+    ofs = 0;
+  }
+  if (pos + n - tail > size) return -1;
+  head = pos + n;
+  allocs.push_back(Alloc{tag, head, false});
+  return (off_t)(base + ofs);
+}
+
+void ShmRing::release(string const &tag)
+{
+  std::unique_lock< std::mutex > lock(mutex);
+  for (auto &it : allocs) {
+    if (it.tag == tag) it.freed = true;
+  }
+  while (!allocs.empty() && allocs.front().freed) {
+    tail = allocs.front().end;
+    allocs.pop_front();
+  }
+}
+
+
+ShmFile::ShmFile(string const &_fn)
+  :fn(_fn)
+{
+  int fd = open(fn.c_str(), O_RDWR);
+  if (fd < 0) {
+    throw runtime_error(fn + string(": ") + string(strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int err = errno;
+    ::close(fd);
+    throw runtime_error(fn + string(": fstat: ") + string(strerror(err)));
+  }
+  memSize = (size_t)st.st_size;
+  void *p = mmap(nullptr, memSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  int err = errno;
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    throw runtime_error(fn + string(": mmap: ") + string(strerror(err)));
+  }
+  mem = static_cast< char * >(p);
+
+  // Same split as child_pipe.js
+  up.base = (memSize / 2) & ~(size_t)7;
+  up.size = (memSize - up.base) & ~(size_t)7;
+}
+
+ShmFile::~ShmFile()
+{
+  if (mem) munmap(mem, memSize);
+}
+
+
+ChunkFileShm::ChunkFileShm(shared_ptr< ShmFile > const &_shm, string const &_tag)
+  :ChunkFile(_shm->fn),
+   shm(_shm),
+   tag(_tag)
+{
+}
+
+ChunkFileShm::~ChunkFileShm()
+{
+}
+
+off_t ChunkFileShm::writeChunk(char const *data, size_t size)
+{
+  if (size == 0) return 0;
+  off_t off = shm->up.alloc(size, tag);
+  if (off < 0) {
+    errFlag = true;
+    return -1;
+  }
+  memcpy(shm->mem + off, data, size);
+  return off;
+}
+
+bool ChunkFileShm::readChunk(char *data, off_t off, size_t size)
+{
+  if (off < 0 || (size_t)off > shm->memSize || size > shm->memSize - (size_t)off) return false;
+  memcpy(data, shm->mem + off, size);
+  return true;
+}
+
+size_t ChunkFileShm::size()
+{
+  return shm->memSize;
+}
@@ -3,6 +3,22 @@
 #include <mutex>
 #include <zlib.h>
 
+/*
+  How wrJson stores arrays of floating point numbers (vector< double >, arma::Col< float > ...)
+  in blobs. NATIVE keeps full precision. FLOAT32 and FLOAT16 round each value. UINT8 and UINT16
+  quantize linearly over the array's range (the ndarray's range member), so the error is at most
+  range/510 or range/131070. Arrays with NaN or Inf values are always stored natively when
+  quantizing.
+  Readers decode all of these back to the type they're reading into. See ndarray_encoding.h.
+*/
+enum BlobPrecision {
+  BLOB_NATIVE,
+  BLOB_FLOAT32,
+  BLOB_FLOAT16,
+  BLOB_UINT8,
+  BLOB_UINT16,
+};
+
 struct ChunkFile {
   ChunkFile(string const &_fn);
   virtual ~ChunkFile();
@@ -17,6 +33,11 @@ struct ChunkFile {
 
   string fn;
   bool errFlag {false};
+
+  // Opt-in encodings for float arrays written to this file. deltaEncode stores each element
+  // relative to the previous one, which compresses much better for slowly varying time series.
+  BlobPrecision floatPrecision {BLOB_NATIVE};
+  bool deltaEncode {false};
 };
 
 
@@ -50,6 +71,9 @@ struct ChunkFileCompressed : ChunkFile {
   ChunkFileCompressed(string const &_fn);
   ~ChunkFileCompressed();
 
+  // Flush and close the file. Returns false if any write failed. Later writes fail.
+  bool close();
+
   off_t writeChunk(char const *data, size_t size) override;
   bool readChunk(char *data, off_t off, size_t size) override;
   size_t size() override;
@@ -74,3 +98,64 @@ struct ChunkFileReader : ChunkFile {
 
   vector< char > fileContents;
 };
+
+
+/*
+  A file mapped into both ChildJsonPipe (with the shareMem option) and its child, for passing
+  big arrays by offset instead of as text. child_pipe.js creates it and passes the name in
+  $TLBCORE_SHM. The first half carries arrays from the parent to the child, the second half
+  from the child back to the parent.
+  Each half is a ring of allocations tagged with the id of the call they belong to. A tag's
+  allocations are released when the reader says it's done with that call, and space is reused
+  once everything before it is released. The child only allocates in the second half (up);
+  the parent manages the first.
+*/
+struct ShmRing {
+  // Offset of n bytes tagged with tag, or -1 if there's no room
+  off_t alloc(size_t n, string const &tag);
+  void release(string const &tag);
+
+  struct Alloc {
+    string tag;
+    U64 end;
+    bool freed;
+  };
+
+  std::mutex mutex;
+  size_t base {0};
+  size_t size {0};
+  // Positions count up forever, and wrap modulo size
+  U64 head {0};
+  U64 tail {0};
+  deque< Alloc > allocs;
+};
+
+struct ShmFile {
+  explicit ShmFile(string const &_fn);
+  ~ShmFile();
+  ShmFile(ShmFile const &) = delete;
+  ShmFile(ShmFile &&) = delete;
+  ShmFile & operator=(ShmFile const &) = delete;
+  ShmFile & operator=(ShmFile &&) = delete;
+
+  string fn;
+  char *mem {nullptr};
+  size_t memSize {0};
+  ShmRing up;
+};
+
+/*
+  The blobs of one call through a ShmFile. Reads can be anywhere in the file, writes allocate
+  in the up ring tagged with the call's id. When the ring is full, writeChunk sets errFlag.
+*/
+struct ChunkFileShm : ChunkFile {
+  ChunkFileShm(shared_ptr< ShmFile > const &_shm, string const &_tag);
+  ~ChunkFileShm();
+
+  off_t writeChunk(char const *data, size_t size) override;
+  bool readChunk(char *data, off_t off, size_t size) override;
+  size_t size() override;
+
+  shared_ptr< ShmFile > shm;
+  string tag;
+};
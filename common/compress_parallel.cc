@@ -0,0 +1,386 @@
+#include "tlbcore/common/std_headers.h"
+#include "./compress_parallel.h"
+#include "./parengine.h"
+#include <atomic>
+#if defined(USE_ZSTD)
+#include <zstd.h>
+#endif
+
+// Same limit as jsonstr::startWrite, checked before allocating from sizes in the file
+static const size_t MAX_DECOMPRESSED_SIZE = 1000000000;
+
+/*
+  Each member starts with a fixed 20 byte header: the 10 byte gzip header with FEXTRA set,
+  XLEN=8, and one 'TB' subfield holding the total size of the member. It ends with the usual
+  8 byte trailer of CRC32 and ISIZE.
+*/
+static const size_t MEMBER_HEADER_SIZE = 20;
+static const size_t MEMBER_TRAILER_SIZE = 8;
+
+static void putU32(char *p, U32 v)
+{
+  p[0] = (char)(v & 0xff);
+  p[1] = (char)((v >> 8) & 0xff);
+  p[2] = (char)((v >> 16) & 0xff);
+  p[3] = (char)((v >> 24) & 0xff);
+}
+
+static U32 getU32(char const *p)
+{
+  U8 const *u = reinterpret_cast< U8 const * >(p);
+  return (U32)u[0] | ((U32)u[1] << 8) | ((U32)u[2] << 16) | ((U32)u[3] << 24);
+}
+
+/*
+  Run fn(0) ... fn(nBlocks-1), on up to nThreads threads taking blocks in order
+*/
+template<typename F>
+static void runBlocks(size_t nBlocks, size_t nThreads, F const &fn)
+{
+  if (nThreads == 0) nThreads = thread::hardware_concurrency();
+  if (nBlocks <= 1 || nThreads <= 1) {
+    for (size_t bi = 0; bi < nBlocks; bi++) fn(bi);
+    return;
+  }
+  ParEngine pe(nThreads);
+  atomic< size_t > nextBlock {0};
+  for (size_t ti = 0; ti < min(nThreads, nBlocks); ti++) {
+    pe.push(thread([&nextBlock, nBlocks, &fn]() {
+      while (true) {
+        size_t bi = nextBlock++;
+        if (bi >= nBlocks) break;
+        fn(bi);
+      }
+    }));
+  }
+  pe.finish();
+}
+
+
+/* ----------------------------------------------------------------------
+   Compression
+*/
+
+static bool deflateMember(char const *data, size_t size, int level, string &member)
+{
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  member.resize(MEMBER_HEADER_SIZE + deflateBound(&zs, size) + MEMBER_TRAILER_SIZE);
+  zs.next_in = (Bytef *)data;
+  zs.avail_in = (uInt)size;
+  zs.next_out = (Bytef *)&member[MEMBER_HEADER_SIZE];
+  zs.avail_out = (uInt)(member.size() - MEMBER_HEADER_SIZE);
+  int rc = deflate(&zs, Z_FINISH);
+  size_t compSize = zs.total_out;
+  deflateEnd(&zs);
+  if (rc != Z_STREAM_END) return false;
+
+  member.resize(MEMBER_HEADER_SIZE + compSize + MEMBER_TRAILER_SIZE);
+  char *p = &member[0];
+  static const char head[16] = {
+    '\x1f', '\x8b', 8, 4, // magic, deflate, FEXTRA
+    0, 0, 0, 0, // mtime
+    0, '\xff', // xfl, os=unknown
+    8, 0, // xlen
+    'T', 'B', 4, 0 // subfield id and length
+  };
+  memcpy(p, head, sizeof(head));
+  putU32(p + 16, (U32)member.size());
+  char *trailer = p + MEMBER_HEADER_SIZE + compSize;
+  putU32(trailer, (U32)crc32(0, (Bytef const *)data, (uInt)size));
+  putU32(trailer + 4, (U32)size);
+  return true;
+}
+
+void gzipParallel(char const *data, size_t size, string &out, int level, size_t nThreads, size_t blockSize)
+{
+  // Keep members under 4 GB so the size fits in the 'TB' subfield
+  blockSize = max((size_t)65536, min(blockSize, (size_t)1 << 30));
+  size_t nBlocks = max((size_t)1, (size + blockSize - 1) / blockSize);
+
+  vector< string > members(nBlocks);
+  vector< char > failed(nBlocks, 0);
+  runBlocks(nBlocks, nThreads, [data, size, blockSize, level, &members, &failed](size_t bi) {
+    size_t lo = bi * blockSize;
+    size_t hi = min(size, lo + blockSize);
+    failed[bi] = !deflateMember(data + lo, hi - lo, level, members[bi]);
+  });
+
+  size_t total = 0;
+  for (size_t bi = 0; bi < nBlocks; bi++) {
+    if (failed[bi]) throw runtime_error("gzipParallel: deflate failed");
+    total += members[bi].size();
+  }
+  out.resize(total);
+  char *p = &out[0];
+  for (auto &it : members) {
+    memcpy(p, it.data(), it.size());
+    p += it.size();
+  }
+}
+
+
+/* ----------------------------------------------------------------------
+   Decompression
+*/
+
+/*
+  Parse a gzip member header at p. Sets hdrLen, and memberSize from a 'TB' subfield or to 0
+  if it doesn't have one.
+*/
+static bool parseMemberHeader(U8 const *p, size_t avail, size_t &hdrLen, size_t &memberSize)
+{
+  if (avail < 10 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8) return false;
+  U8 flags = p[3];
+  size_t pos = 10;
+  memberSize = 0;
+  if (flags & 4) { // FEXTRA
+    if (pos + 2 > avail) return false;
+    size_t xlen = (size_t)p[pos] | ((size_t)p[pos+1] << 8);
+    pos += 2;
+    if (pos + xlen > avail) return false;
+    size_t xend = pos + xlen;
+    while (pos + 4 <= xend) {
+      size_t sublen = (size_t)p[pos+2] | ((size_t)p[pos+3] << 8);
+      if (p[pos] == 'T' && p[pos+1] == 'B' && sublen == 4 && pos + 8 <= xend) {
+        memberSize = getU32(reinterpret_cast< char const * >(p + pos + 4));
+      }
+      pos += 4 + sublen;
+    }
+    pos = xend;
+  }
+  for (U8 strFlag : {(U8)8, (U8)16}) { // FNAME, FCOMMENT
+    if (flags & strFlag) {
+      while (pos < avail && p[pos] != 0) pos++;
+      pos++;
+    }
+  }
+  if (flags & 2) pos += 2; // FHCRC
+  if (pos > avail) return false;
+  hdrLen = pos;
+  return true;
+}
+
+struct GzipMember {
+  size_t inOfs;
+  size_t hdrLen;
+  size_t inSize;
+  size_t outOfs;
+  size_t outSize;
+};
+
+/*
+  Find all the members, if they all have 'TB' subfields. Otherwise return false, and the
+  caller inflates serially.
+*/
+static bool findMembers(char const *data, size_t size, vector< GzipMember > &members)
+{
+  size_t pos = 0, outOfs = 0;
+  while (pos < size) {
+    GzipMember m;
+    m.inOfs = pos;
+    if (!parseMemberHeader(reinterpret_cast< U8 const * >(data + pos), size - pos, m.hdrLen, m.inSize)) return false;
+    if (m.inSize < m.hdrLen + MEMBER_TRAILER_SIZE || m.inSize > size - pos) return false;
+    m.outOfs = outOfs;
+    m.outSize = getU32(data + pos + m.inSize - 4);
+    outOfs += m.outSize;
+    if (outOfs > MAX_DECOMPRESSED_SIZE) return false;
+    members.push_back(m);
+    pos += m.inSize;
+  }
+  return !members.empty();
+}
+
+static bool inflateMember(char const *data, GzipMember const &m, char *outp)
+{
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) return false;
+  char dummy;
+  zs.next_in = (Bytef *)(data + m.inOfs + m.hdrLen);
+  zs.avail_in = (uInt)(m.inSize - m.hdrLen - MEMBER_TRAILER_SIZE);
+  zs.next_out = (Bytef *)(m.outSize ? outp : &dummy);
+  zs.avail_out = (uInt)m.outSize;
+  int rc = inflate(&zs, Z_FINISH);
+  bool ok = rc == Z_STREAM_END && zs.avail_out == 0 && zs.avail_in == 0;
+  inflateEnd(&zs);
+  if (!ok) return false;
+  char const *trailer = data + m.inOfs + m.inSize - MEMBER_TRAILER_SIZE;
+  return getU32(trailer) == (U32)crc32(0, (Bytef const *)outp, (uInt)m.outSize);
+}
+
+/*
+  Inflate any gzip stream, including concatenated members. Like gzread, stops quietly at
+  trailing junk after a complete member.
+*/
+static bool gunzipSerial(char const *data, size_t size, string &out, string &err)
+{
+  // ISIZE of the last member is the whole size (mod 2^32) for a single-member file. Ignore it
+  // if it's implausible, as when there's junk at the end. The +1 lets inflate see the end of
+  // the stream without filling the buffer first.
+  size_t hint = size >= 4 ? getU32(data + size - 4) : 0;
+  if (hint > size * 256 || hint > MAX_DECOMPRESSED_SIZE) hint = size * 4;
+  out.resize(max((size_t)65536, min(hint + 1, MAX_DECOMPRESSED_SIZE)));
+
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+    err = "inflateInit failed";
+    return false;
+  }
+  zs.next_in = (Bytef *)data;
+  zs.avail_in = (uInt)size;
+  size_t produced = 0;
+  while (true) {
+    if (produced == out.size()) {
+      if (out.size() >= MAX_DECOMPRESSED_SIZE) {
+        err = "unreasonable decompressed size";
+        inflateEnd(&zs);
+        return false;
+      }
+      out.resize(min(out.size() * 2, MAX_DECOMPRESSED_SIZE));
+    }
+    zs.next_out = (Bytef *)&out[produced];
+    zs.avail_out = (uInt)(out.size() - produced);
+    int rc = inflate(&zs, Z_NO_FLUSH);
+    produced = out.size() - zs.avail_out;
+    if (rc == Z_STREAM_END) {
+      if (zs.avail_in >= 2 && zs.next_in[0] == 0x1f && zs.next_in[1] == 0x8b) {
+        inflateReset(&zs);
+        continue;
+      }
+      break;
+    }
+    if (rc == Z_BUF_ERROR && zs.avail_out > 0) {
+      err = "unexpected end of file";
+      inflateEnd(&zs);
+      return false;
+    }
+    if (rc != Z_OK && rc != Z_BUF_ERROR) {
+      err = zs.msg ? zs.msg : "inflate failed";
+      inflateEnd(&zs);
+      return false;
+    }
+  }
+  inflateEnd(&zs);
+  out.resize(produced);
+  return true;
+}
+
+bool gunzipParallel(char const *data, size_t size, string &out, string &err, size_t nThreads)
+{
+  vector< GzipMember > members;
+  if (!findMembers(data, size, members)) {
+    return gunzipSerial(data, size, out, err);
+  }
+
+  out.resize(members.back().outOfs + members.back().outSize);
+  char *outp = &out[0];
+  vector< char > failed(members.size(), 0);
+  runBlocks(members.size(), nThreads, [data, outp, &members, &failed](size_t bi) {
+    failed[bi] = !inflateMember(data, members[bi], outp + members[bi].outOfs);
+  });
+  for (size_t bi = 0; bi < members.size(); bi++) {
+    if (failed[bi]) {
+      err = "corrupt gzip member at offset " + to_string(members[bi].inOfs);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+#if defined(USE_ZSTD)
+/* ----------------------------------------------------------------------
+   Zstd
+*/
+
+void zstdParallel(char const *data, size_t size, string &out, int level, size_t nThreads)
+{
+  if (nThreads == 0) nThreads = thread::hardware_concurrency();
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  if (!cctx) throw runtime_error("zstd: createCCtx failed");
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+  if (size >= GZIP_PARALLEL_BLOCK_SIZE && nThreads > 1) {
+    // Fails harmlessly (compressing on this thread) if libzstd was built without threads
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, (int)nThreads);
+  }
+  out.resize(ZSTD_compressBound(size));
+  size_t rc = ZSTD_compress2(cctx, &out[0], out.size(), data, size);
+  ZSTD_freeCCtx(cctx);
+  if (ZSTD_isError(rc)) {
+    throw runtime_error(string("zstd: ") + ZSTD_getErrorName(rc));
+  }
+  out.resize(rc);
+}
+
+bool unzstd(char const *data, size_t size, string &out, string &err)
+{
+  unsigned long long contentSize = ZSTD_findDecompressedSize(data, size);
+  if (contentSize == ZSTD_CONTENTSIZE_ERROR) {
+    err = "not a zstd file";
+    return false;
+  }
+  if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN) {
+    if (contentSize > MAX_DECOMPRESSED_SIZE) {
+      err = "unreasonable decompressed size";
+      return false;
+    }
+    out.resize((size_t)contentSize);
+    char dummy;
+    size_t rc = ZSTD_decompress(contentSize ? &out[0] : &dummy, out.size(), data, size);
+    if (ZSTD_isError(rc)) {
+      err = ZSTD_getErrorName(rc);
+      return false;
+    }
+    if (rc != contentSize) {
+      err = "wrong decompressed size";
+      return false;
+    }
+    return true;
+  }
+
+  // Written by a streaming compressor that didn't record the size
+  ZSTD_DStream *ds = ZSTD_createDStream();
+  if (!ds) {
+    err = "createDStream failed";
+    return false;
+  }
+  out.resize(max((size_t)65536, size * 4));
+  ZSTD_inBuffer in {data, size, 0};
+  size_t produced = 0;
+  size_t rc = 1;
+  bool ok = true;
+  while (ok && (in.pos < in.size || rc != 0)) {
+    if (produced == out.size()) {
+      if (out.size() >= MAX_DECOMPRESSED_SIZE) {
+        err = "unreasonable decompressed size";
+        ok = false;
+        break;
+      }
+      out.resize(min(out.size() * 2, MAX_DECOMPRESSED_SIZE));
+    }
+    ZSTD_outBuffer ob {&out[0], out.size(), produced};
+    size_t inPos = in.pos;
+    rc = ZSTD_decompressStream(ds, &ob, &in);
+    if (ZSTD_isError(rc)) {
+      err = ZSTD_getErrorName(rc);
+      ok = false;
+      break;
+    }
+    if (ob.pos == produced && in.pos == inPos && ob.pos < ob.size) {
+      err = "unexpected end of file";
+      ok = false;
+      break;
+    }
+    produced = ob.pos;
+  }
+  ZSTD_freeDStream(ds);
+  if (!ok) return false;
+  out.resize(produced);
+  return true;
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+#include <zlib.h>
+
+/*
+  Multi-threaded compression for large files such as snapshots.
+
+  gzipParallel works like pigz: it splits the input into blocks, deflates each block on its own
+  thread, and concatenates the results as gzip members. Any gzip reader (gzread, zcat, node's
+  zlib) reads the concatenation as one stream. Like BGZF, each member header has an extra
+  field (subfield 'TB') giving the compressed size of the member. That lets gunzipParallel find
+  all the members without inflating, size the output from each member's ISIZE trailer, and
+  inflate the members in parallel straight into place.
+
+  gunzipParallel reads any other gzip file on one thread, using the ISIZE trailer as a size hint
+  so the output is allocated once in the common case.
+
+  nThreads=0 means thread::hardware_concurrency().
+
+  The zstd versions exist when built with USE_ZSTD (and -lzstd). They use zstd's own worker
+  threads for compression. Both compressors run inline, without threads, for inputs smaller
+  than one block.
+*/
+
+static const size_t GZIP_PARALLEL_BLOCK_SIZE = 1 << 20;
+
+void gzipParallel(char const *data, size_t size, string &out,
+  int level = Z_DEFAULT_COMPRESSION, size_t nThreads = 0, size_t blockSize = GZIP_PARALLEL_BLOCK_SIZE);
+bool gunzipParallel(char const *data, size_t size, string &out, string &err, size_t nThreads = 0);
+
+#if defined(USE_ZSTD)
+void zstdParallel(char const *data, size_t size, string &out, int level = 3, size_t nThreads = 0);
+bool unzstd(char const *data, size_t size, string &out, string &err);
+#endif
@@ -6,6 +6,7 @@
 #include <regex.h>
 #include <netdb.h>
 #include <typeindex>
+#include <chrono>
 
 
 char *
@@ -303,9 +304,27 @@ charname_hex(int ci)
 }
 
 
+/*
+  getln and getall return malloced strings, which the caller should free.
+  getln uses getline(3), which scans stdio's buffer with memchr rather than taking a lock
+  per character with getc. For big files, see LineReader in line_reader.h.
+*/
 char *
 getln(FILE *f)
 {
+#if !defined(WIN32)
+  char *line = nullptr;
+  size_t alloc_line = 0;
+  ssize_t n_line = getline(&line, &alloc_line, f);
+  if (n_line < 0) {
+    free(line);
+    return nullptr;
+  }
+  if (n_line>=1 && line[n_line-1]=='\n') n_line--;
+  if (n_line>=1 && line[n_line-1]=='\r') n_line--;
+  line[n_line]=0;
+  return line;
+#else
   int c;
   int alloc_line=1024;
   int n_line=0;
@@ -333,39 +352,40 @@ getln(FILE *f)
 
   line = static_cast<char *>(realloc(line, n_line));
   return line;
+#endif
 }
 
 char *
 getall(FILE *f)
 {
-  int c;
-  int alloc_line=1024;
-  int n_line=0;
-  char *line = static_cast<char *>(malloc(alloc_line));
+  size_t alloc_line=65536;
+  size_t n_line=0;
+  auto line = static_cast<char *>(malloc(alloc_line));
 
   while (1) {
-    c=getc(f);
-    if (c==EOF && feof(f)) {
-      if (n_line==0) {
-        free(line);
-        return nullptr;
-      }
-      break;
-    }
-
-    if (n_line+5 >= alloc_line) {
-      alloc_line*=2;
+    if (n_line+1 >= alloc_line) {
+      alloc_line *= 2;
       line = static_cast<char *>(realloc(line, alloc_line));
     }
-    line[n_line++]=c;
+    size_t nr = fread(line+n_line, 1, alloc_line-1-n_line, f);
+    if (nr == 0) break;
+    n_line += nr;
+  }
+  if (n_line==0) {
+    free(line);
+    return nullptr;
   }
   line[n_line++]=0;
 
-  line = static_cast<char *>(realloc(line,n_line));
+  line = static_cast<char *>(realloc(line, n_line));
   return line;
 }
 
 #ifndef WIN32
+/*
+  Read a whole file. Regular files are sized with fstat and read in a single read call.
+  Pipes and such are read in chunks, doubling the buffer as needed.
+*/
 string file_string(string const &fn)
 {
   string ret;
@@ -375,21 +395,30 @@ string file_string(string const &fn)
     return stringprintf("error opening %s: %s\n", fn.c_str(), strerror(errno));
   }
 
+  struct stat st {};
+  bool isReg = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+  // One byte more than the file size, so a short read tells us we've hit EOF
+  ret.resize(isReg ? (size_t)st.st_size + 1 : 65536);
+  size_t n_ret = 0;
   while (1) {
-    char buf[8192];
-    int nr = read(fd, buf, sizeof(buf));
+    if (n_ret == ret.size()) {
+      ret.resize(ret.size() * 2);
+    }
+    ssize_t nr = read(fd, &ret[n_ret], ret.size() - n_ret);
     if (nr < 0) {
+      if (errno == EINTR) continue;
       ret = stringprintf("error reading %s: %s\n", fn.c_str(), strerror(errno));
-      break;
+      close(fd);
+      return ret;
     }
     else if (nr == 0) {
       break;
     }
-    else {
-      ret += string(&buf[0], &buf[nr]);
-    }
+    n_ret += (size_t)nr;
+    if (isReg && n_ret < ret.size()) break;
   }
   close(fd);
+  ret.resize(n_ret);
   return ret;
 }
 #endif
@@ -432,14 +461,14 @@ tmpfn::~tmpfn()
 }
 
 
-#if defined(__linux__)
-
-FILE *mfopen()
-{
-  return fmemopen(nullptr, 65536, "w");
-}
+/*
+  In-memory FILEs. They grow as needed, using fopencookie on Linux and funopen on BSD/OSX.
+  mfopen_ro wraps an existing buffer without copying it. mfopen_buf works like open_memstream,
+  except the stream is also readable and seekable: after fflush or fclose, *datap and *n_datap
+  describe the (null-terminated) contents, and after fclose the caller owns *datap and should free it.
+*/
 
-#elif defined(WIN32)
+#if defined(WIN32)
 
 // WRITEME if needed
 
@@ -447,89 +476,194 @@ FILE *mfopen()
 
 struct memfile {
   char *data;
-  int ofs;
-  int n_data;
-  int alloc_data;
+  size_t ofs;
+  size_t n_data;
+  size_t alloc_data;
+  bool owned;
+  char **user_data;
+  size_t *user_n_data;
 };
 
-static int memfile_read(void *cookie, char *buf, int n)
+static memfile *memfile_new()
 {
-  auto mf = reinterpret_cast<memfile *>(cookie);
+  auto mf = new memfile;
+  mf->data = nullptr;
+  mf->ofs = 0;
+  mf->n_data = 0;
+  mf->alloc_data = 0;
+  mf->owned = true;
+  mf->user_data = nullptr;
+  mf->user_n_data = nullptr;
+  return mf;
+}
 
-  int nr=min(n,mf->n_data - mf->ofs);
+static void memfile_reserve(memfile *mf, size_t n)
+{
+  if (n > mf->alloc_data) {
+    mf->alloc_data = max(mf->alloc_data*2, n+1024);
+    mf->data = static_cast<char *>(realloc(mf->data, mf->alloc_data));
+  }
+}
+
+static size_t memfile_read_core(memfile *mf, char *buf, size_t n)
+{
+  size_t nr = mf->ofs < mf->n_data ? min(n, mf->n_data - mf->ofs) : 0;
   if (nr>0) memcpy(buf, mf->data+mf->ofs, nr);
   mf->ofs += nr;
   return nr;
 }
 
-static int memfile_write(void *cookie, const char *buf, int n)
+static size_t memfile_write_core(memfile *mf, const char *buf, size_t n)
 {
-  auto mf = reinterpret_cast<memfile *>(cookie);
-
-  if (mf->ofs+n > mf->alloc_data) {
-    mf->alloc_data = max(mf->alloc_data*2, mf->ofs+n+1024);
-    mf->data = static_cast<char *>(realloc(mf->data, mf->alloc_data));
-  }
+  // +1 so there's always room for a terminating null
+  memfile_reserve(mf, mf->ofs+n+1);
   if (mf->ofs > mf->n_data) {
     memset(mf->data+mf->n_data, 0, mf->ofs-mf->n_data);
   }
   memcpy(mf->data+mf->ofs, buf, n);
   mf->ofs += n;
   mf->n_data = max(mf->n_data,mf->ofs);
+  mf->data[mf->n_data] = 0;
+  if (mf->user_data) *mf->user_data = mf->data;
+  if (mf->user_n_data) *mf->user_n_data = mf->n_data;
   return n;
 }
 
-static off_t memfile_seek(void *cookie, off_t offset, int whence)
+static bool memfile_seek_core(memfile *mf, S64 &offset, int whence)
 {
-  auto mf = reinterpret_cast<memfile *>(cookie);
+  S64 newofs;
   if (whence == SEEK_SET) {
-    mf->ofs = offset;
+    newofs = offset;
   }
   else if (whence == SEEK_CUR) {
-    mf->ofs += offset;
+    newofs = (S64)mf->ofs + offset;
   }
   else if (whence == SEEK_END) {
-    mf->ofs = mf->n_data + offset;
+    newofs = (S64)mf->n_data + offset;
+  }
+  else {
+    errno = EINVAL;
+    return false;
+  }
+  if (newofs < 0) {
+    errno = EINVAL;
+    return false;
   }
-  return mf->ofs;
+  mf->ofs = (size_t)newofs;
+  offset = newofs;
+  return true;
 }
 
 static int memfile_close(void *cookie)
 {
   auto mf = reinterpret_cast<memfile *>(cookie);
-  free(mf->data);
+  if (mf->owned && !mf->user_data) free(mf->data);
+  delete mf;
   return 0;
 }
 
-FILE *mfopen()
+#if defined(__linux__)
+
+static ssize_t memfile_read(void *cookie, char *buf, size_t n)
 {
-  auto mf = new memfile;
-  mf->data = nullptr;
-  mf->ofs = 0;
-  mf->n_data = 0;
-  mf->alloc_data = 0;
-  return funopen(mf, memfile_read, memfile_write, memfile_seek, memfile_close);
+  return (ssize_t)memfile_read_core(reinterpret_cast<memfile *>(cookie), buf, n);
+}
+
+static ssize_t memfile_write(void *cookie, const char *buf, size_t n)
+{
+  return (ssize_t)memfile_write_core(reinterpret_cast<memfile *>(cookie), buf, n);
+}
+
+static int memfile_seek(void *cookie, off64_t *offset, int whence)
+{
+  S64 off = *offset;
+  if (!memfile_seek_core(reinterpret_cast<memfile *>(cookie), off, whence)) return -1;
+  *offset = off;
+  return 0;
+}
+
+static FILE *memfile_fopen(memfile *mf, bool writable)
+{
+  cookie_io_functions_t funcs {};
+  funcs.read = memfile_read;
+  funcs.write = writable ? memfile_write : nullptr;
+  funcs.seek = memfile_seek;
+  funcs.close = memfile_close;
+  FILE *ret = fopencookie(mf, writable ? "w+" : "r", funcs);
+  if (!ret) memfile_close(mf);
+  return ret;
+}
+
+#else
+
+static int memfile_read(void *cookie, char *buf, int n)
+{
+  return (int)memfile_read_core(reinterpret_cast<memfile *>(cookie), buf, (size_t)n);
+}
+
+static int memfile_write(void *cookie, const char *buf, int n)
+{
+  return (int)memfile_write_core(reinterpret_cast<memfile *>(cookie), buf, (size_t)n);
+}
+
+static off_t memfile_seek(void *cookie, off_t offset, int whence)
+{
+  S64 off = offset;
+  if (!memfile_seek_core(reinterpret_cast<memfile *>(cookie), off, whence)) return -1;
+  return (off_t)off;
+}
+
+static FILE *memfile_fopen(memfile *mf, bool writable)
+{
+  FILE *ret = funopen(mf, memfile_read, writable ? memfile_write : nullptr, memfile_seek, memfile_close);
+  if (!ret) memfile_close(mf);
+  return ret;
 }
 
 #endif
 
-#if !defined(WIN32)
+FILE *mfopen()
+{
+  return memfile_fopen(memfile_new(), true);
+}
+
 FILE *mfopen_str(const char *s)
 {
-  FILE *mf = mfopen();
-  fputs(s, mf);
-  rewind(mf);
-  return mf;
+  return mfopen_data(s, strlen(s));
 }
 
+FILE *mfopen_data(const char *d, size_t n_d)
+{
+  auto mf = memfile_new();
+  memfile_reserve(mf, n_d+1);
+  memcpy(mf->data, d, n_d);
+  mf->n_data = n_d;
+  mf->data[n_d] = 0;
+  return memfile_fopen(mf, true);
+}
 
-FILE *mfopen_data(const char *d, int n_d)
+FILE *mfopen_ro(const char *d, size_t n_d)
 {
-  FILE *mf = mfopen();
-  fwrite(d, 1, n_d, mf);
-  rewind(mf);
-  return mf;
+  auto mf = memfile_new();
+  mf->data = const_cast<char *>(d);
+  mf->n_data = n_d;
+  mf->alloc_data = n_d;
+  mf->owned = false;
+  return memfile_fopen(mf, false);
+}
+
+FILE *mfopen_buf(char **datap, size_t *n_datap)
+{
+  auto mf = memfile_new();
+  memfile_reserve(mf, 1);
+  mf->data[0] = 0;
+  mf->user_data = datap;
+  mf->user_n_data = n_datap;
+  *datap = mf->data;
+  *n_datap = 0;
+  return memfile_fopen(mf, true);
 }
+
 #endif
 
 double frac(double x)
@@ -557,6 +691,46 @@ double realtime()
 #endif
 }
 
+/*
+  Integer nanoseconds since an arbitrary epoch, unaffected by changes to the wall clock.
+  The coarse version is only updated every timer tick (1-4 mS on Linux), but it's read from
+  the vDSO without touching the hardware counter, so it's several times cheaper.
+*/
+int64_t monotonic_ns()
+{
+#if defined(WIN32)
+  return (int64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+  timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + (int64_t)ts.tv_nsec;
+#endif
+}
+
+int64_t monotonic_coarse_ns()
+{
+#if defined(CLOCK_MONOTONIC_COARSE)
+  timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + (int64_t)ts.tv_nsec;
+#else
+  return monotonic_ns();
+#endif
+}
+
+/*
+  A cheap version of realtime() for timeout checks in hot loops. It's monotonic_coarse_ns,
+  offset to agree with realtime() the first time it's called. So it's only as fresh as the
+  kernel's timer tick (1-4 mS on Linux), and doesn't jump when the wall clock is set. If the
+  wall clock is set, it stops agreeing with realtime() by that much.
+*/
+double realtime_cached()
+{
+  static double const offset = realtime() - 1e-9 * (double)monotonic_coarse_ns();
+  return offset + 1e-9 * (double)monotonic_coarse_ns();
+}
+
 int re_match_hostname(const char *re)
 {
   char hostname[256];
@@ -744,3 +918,116 @@ int32_t jump_consistent_hash(uint64_t key, int32_t num_buckets)
   }
   return b;
 }
+
+/*
+  Batched version. Keys are run JUMP_HASH_LANES at a time, with each lane doing the same steps
+  as the scalar version until every lane has jumped past num_buckets. The lane loop is
+  branch-free, so the compiler can turn it into vector multiplies and a vector divide.
+  Results are identical to jump_consistent_hash.
+*/
+static const size_t JUMP_HASH_LANES = 8;
+
+void jump_consistent_hash(uint64_t const *keys, int32_t *buckets, size_t n_keys, int32_t num_buckets)
+{
+  size_t i = 0;
+  for (; i + JUMP_HASH_LANES <= n_keys; i += JUMP_HASH_LANES) {
+    uint64_t key[JUMP_HASH_LANES];
+    int64_t b[JUMP_HASH_LANES], j[JUMP_HASH_LANES];
+    for (size_t l = 0; l < JUMP_HASH_LANES; l++) {
+      key[l] = keys[i + l];
+      b[l] = -1;
+      j[l] = 0;
+    }
+    while (true) {
+      bool active = false;
+      for (size_t l = 0; l < JUMP_HASH_LANES; l++) {
+        active |= j[l] < num_buckets;
+      }
+      if (!active) break;
+      for (size_t l = 0; l < JUMP_HASH_LANES; l++) {
+        bool live = j[l] < num_buckets;
+        b[l] = live ? j[l] : b[l];
+        uint64_t nextKey = key[l] * 2862933555777941757ULL + 1;
+        key[l] = live ? nextKey : key[l];
+        int64_t nextJ = (b[l] + 1) * (double(1LL << 31) / double((key[l] >> 33) + 1));
+        j[l] = live ? nextJ : j[l];
+      }
+    }
+    for (size_t l = 0; l < JUMP_HASH_LANES; l++) {
+      buckets[i + l] = (int32_t)b[l];
+    }
+  }
+  for (; i < n_keys; i++) {
+    buckets[i] = jump_consistent_hash(keys[i], num_buckets);
+  }
+}
+
+/*
+  Report which keys change buckets when going from old_num_buckets to new_num_buckets, and where
+  they go. Jump hash only moves keys into the added buckets when growing (or out of the removed
+  ones when shrinking), so a key moves iff its bucket under the larger count is >= the smaller
+  count. Growing takes one hash per key, shrinking one more per moved key.
+*/
+void jump_consistent_hash_moves(uint64_t const *keys, size_t n_keys,
+                                int32_t old_num_buckets, int32_t new_num_buckets,
+                                vector< size_t > &moved_indexes, vector< int32_t > &moved_to)
+{
+  moved_indexes.clear();
+  moved_to.clear();
+  if (old_num_buckets == new_num_buckets) return;
+  int32_t lo = min(old_num_buckets, new_num_buckets);
+  int32_t hi = max(old_num_buckets, new_num_buckets);
+
+  vector< int32_t > hiBuckets(n_keys);
+  jump_consistent_hash(keys, hiBuckets.data(), n_keys, hi);
+  for (size_t i = 0; i < n_keys; i++) {
+    if (hiBuckets[i] >= lo) {
+      moved_indexes.push_back(i);
+    }
+  }
+
+  if (new_num_buckets == hi) {
+    for (auto i : moved_indexes) {
+      moved_to.push_back(hiBuckets[i]);
+    }
+  }
+  else {
+    vector< uint64_t > movedKeys;
+    movedKeys.reserve(moved_indexes.size());
+    for (auto i : moved_indexes) {
+      movedKeys.push_back(keys[i]);
+    }
+    moved_to.resize(movedKeys.size());
+    jump_consistent_hash(movedKeys.data(), moved_to.data(), movedKeys.size(), new_num_buckets);
+  }
+}
+
+JumpHashSharder::JumpHashSharder(int32_t _num_buckets)
+  :num_buckets(_num_buckets)
+{
+  if (num_buckets < 1) throw runtime_error("JumpHashSharder: num_buckets must be positive");
+}
+
+int32_t JumpHashSharder::shard(uint64_t key) const
+{
+  return jump_consistent_hash(key, num_buckets);
+}
+
+void JumpHashSharder::shard(uint64_t const *keys, int32_t *buckets, size_t n_keys) const
+{
+  jump_consistent_hash(keys, buckets, n_keys, num_buckets);
+}
+
+void JumpHashSharder::shard(vector< uint64_t > const &keys, vector< int32_t > &buckets) const
+{
+  buckets.resize(keys.size());
+  jump_consistent_hash(keys.data(), buckets.data(), keys.size(), num_buckets);
+}
+
+void JumpHashSharder::resize(int32_t new_num_buckets, uint64_t const *keys, size_t n_keys,
+                             vector< size_t > &moved_indexes, vector< int32_t > &moved_to)
+{
+  if (new_num_buckets < 1) throw runtime_error("JumpHashSharder: num_buckets must be positive");
+  jump_consistent_hash_moves(keys, n_keys, num_buckets, new_num_buckets, moved_indexes, moved_to);
+  num_buckets = new_num_buckets;
+}
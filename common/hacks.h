@@ -107,7 +107,9 @@ int flscanf(FILE *f, const char *fmt, ...);
 
 FILE *mfopen();
 FILE *mfopen_str(const char *s);
-FILE *mfopen_data(const char *d, int n_d);
+FILE *mfopen_data(const char *d, size_t n_d);
+FILE *mfopen_ro(const char *d, size_t n_d);
+FILE *mfopen_buf(char **datap, size_t *n_datap);
 
 
 // Pathnames
@@ -176,9 +178,35 @@ std::string sockaddr_desc(struct sockaddr *sa);
 
 
 double realtime();
+double realtime_cached();
+int64_t monotonic_ns();
+int64_t monotonic_coarse_ns();
 
 int32_t jump_consistent_hash(uint64_t key, int32_t num_buckets);
 
+#ifdef __cplusplus
+void jump_consistent_hash(uint64_t const *keys, int32_t *buckets, size_t n_keys, int32_t num_buckets);
+void jump_consistent_hash_moves(uint64_t const *keys, size_t n_keys,
+                                int32_t old_num_buckets, int32_t new_num_buckets,
+                                vector< size_t > &moved_indexes, vector< int32_t > &moved_to);
+
+/*
+  Shard keys across a fixed number of buckets, and keep track of what moves when the number
+  of buckets changes.
+*/
+struct JumpHashSharder {
+  explicit JumpHashSharder(int32_t _num_buckets);
+
+  int32_t shard(uint64_t key) const;
+  void shard(uint64_t const *keys, int32_t *buckets, size_t n_keys) const;
+  void shard(vector< uint64_t > const &keys, vector< int32_t > &buckets) const;
+  void resize(int32_t new_num_buckets, uint64_t const *keys, size_t n_keys,
+              vector< size_t > &moved_indexes, vector< int32_t > &moved_to);
+
+  int32_t num_buckets;
+};
+#endif
+
 #ifdef __cplusplus
 
 /*
@@ -53,6 +53,25 @@ struct anytimer {
     return dur_seconds;
   }
 
+  /*
+    Versions using realtime_cached (see hacks.cc), for polling in tight loops. They're only
+    good to a few mS, but are several times cheaper.
+  */
+  void set_cached()
+  {
+    time_seconds = realtime_cached();
+  }
+
+  double elapsed_cached() const
+  {
+    return realtime_cached() - time_seconds;
+  }
+
+  bool is_elapsed_cached(double dt) const
+  {
+    return time_seconds == -1.0 || (realtime_cached() - time_seconds) >= dt;
+  }
+
 
   double time_seconds;
   double dur_seconds;
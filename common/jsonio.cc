@@ -1,6 +1,6 @@
 #include "tlbcore/common/std_headers.h"
 #include "./jsonio.h"
-#include <zlib.h>
+#include "./compress_parallel.h"
 
 jsonstr::jsonstr()
   :it("null")
@@ -98,101 +98,118 @@ bool jsonstr::isNumber() const
 }
 
 /*
-  writeToFile uses gzip by default.
+  Write the whole buffer, throwing on any error
 */
-void jsonstr::writeToFile(string const &fn, bool enableGzip) const
+static void writeWholeFile(string const &fn, char const *data, size_t size, bool addNewline)
 {
-  int rc;
-  if (enableGzip) {
-    string gzfn = fn + ".json.gz";
-    gzFile gzfp = gzopen(gzfn.c_str(), "wb");
-    if (!gzfp) {
-      throw runtime_error(gzfn + string(": ") + string(strerror(errno)));
-    }
-    rc = gzwrite(gzfp, (void *)&it[0], (u_int)it.size());
-    if (rc <= 0) {
-      int errnum = 0;
-      throw runtime_error(gzfn + string(": write failed: ") + string(gzerror(gzfp, &errnum)));
-    }
-    rc = gzclose(gzfp);
-    if (rc != Z_OK) {
-      throw runtime_error(gzfn + string(": close failed: ") + to_string(rc));
-    }
-  } else {
-    string jsonfn = fn + ".json";
-    FILE *fp = fopen(jsonfn.c_str(), "w");
-    if (!fp) {
-      throw runtime_error(jsonfn + string(": ") + string(strerror(errno)));
-    }
-    int nw = fwrite(&it[0], it.size(), 1, fp);
+  FILE *fp = fopen(fn.c_str(), "w");
+  if (!fp) {
+    throw runtime_error(fn + string(": ") + string(strerror(errno)));
+  }
+  if (size > 0) {
+    size_t nw = fwrite(data, size, 1, fp);
     if (nw != 1) {
-      throw runtime_error(jsonfn + string(": partial write ") + to_string(nw) + "/" + to_string(it.size()));
-    }
-    fputc('\n', fp); // For human readability
-    if (fclose(fp) < 0) {
-      throw runtime_error(jsonfn + string(": ") + string(strerror(errno)));
+      fclose(fp);
+      throw runtime_error(fn + string(": partial write ") + to_string(nw) + "/" + to_string(size));
     }
   }
+  if (addNewline) fputc('\n', fp); // For human readability
+  if (fclose(fp) < 0) {
+    throw runtime_error(fn + string(": ") + string(strerror(errno)));
+  }
 }
 
 /*
-  readFromFile first checks for a plain file, then looks for a .gz version
- */
-int jsonstr::readFromFile(string const &fn)
+  Read the whole file into contents. Returns false if it can't be opened.
+*/
+static bool readWholeFile(string const &fn, string &contents)
 {
-  int rc;
-
-  string jsonfn = fn + ".json";
-  FILE *fp = fopen(jsonfn.c_str(), "r");
-  if (fp) {
-    if (fseek(fp, 0, SEEK_END) < 0) {
-      throw runtime_error(jsonfn + string(": ") + string(strerror(errno)));
-    }
-    auto fileSize = (size_t)ftello(fp);
-    if (fileSize > 1000000000) {
-      throw runtime_error(jsonfn + string(": Unreasonable file size ") + to_string(fileSize));
-    }
-
-    fseek(fp, 0, SEEK_SET);
-    char *p = startWrite(fileSize);
-    int nr = fread(p, fileSize, 1, fp);
+  FILE *fp = fopen(fn.c_str(), "r");
+  if (!fp) return false;
+  if (fseek(fp, 0, SEEK_END) < 0) {
+    fclose(fp);
+    throw runtime_error(fn + string(": ") + string(strerror(errno)));
+  }
+  auto fileSize = (size_t)ftello(fp);
+  if (fileSize > 1000000000) {
+    fclose(fp);
+    throw runtime_error(fn + string(": Unreasonable file size ") + to_string(fileSize));
+  }
+  fseek(fp, 0, SEEK_SET);
+  contents.resize(fileSize);
+  if (fileSize > 0) {
+    size_t nr = fread(&contents[0], fileSize, 1, fp);
     if (nr != 1) {
-      throw runtime_error(jsonfn + string(": partial read ") + to_string(nr) + "/" + to_string(fileSize));
+      fclose(fp);
+      throw runtime_error(fn + string(": partial read ") + to_string(nr) + "/" + to_string(fileSize));
     }
-    endWrite(p + fileSize);
+  }
+  if (fclose(fp) < 0) {
+    throw runtime_error(fn + string(": ") + string(strerror(errno)));
+  }
+  return true;
+}
 
-    if (fclose(fp) < 0) {
-      throw runtime_error(jsonfn + string(": ") + string(strerror(errno)));
-    }
+/*
+  writeToFile uses gzip by default.
+*/
+void jsonstr::writeToFile(string const &fn, bool enableGzip) const
+{
+  writeToFile(fn, enableGzip ? JSON_FILE_GZIP : JSON_FILE_PLAIN);
+}
+
+void jsonstr::writeToFile(string const &fn, JsonFileCompression compression, size_t nThreads) const
+{
+  if (compression == JSON_FILE_GZIP) {
+    string gzdata;
+    gzipParallel(it.data(), it.size(), gzdata, Z_DEFAULT_COMPRESSION, nThreads);
+    writeWholeFile(fn + ".json.gz", gzdata.data(), gzdata.size(), false);
+  }
+  else if (compression == JSON_FILE_ZSTD) {
+#if defined(USE_ZSTD)
+    string zdata;
+    zstdParallel(it.data(), it.size(), zdata, 3, nThreads);
+    writeWholeFile(fn + ".json.zst", zdata.data(), zdata.size(), false);
+#else
+    throw runtime_error(fn + string(": zstd support not built (needs USE_ZSTD)"));
+#endif
+  }
+  else {
+    writeWholeFile(fn + ".json", it.data(), it.size(), true);
+  }
+}
+
+/*
+  readFromFile first checks for a plain file, then looks for a .gz version, then .zst
+ */
+int jsonstr::readFromFile(string const &fn, size_t nThreads)
+{
+  string jsonfn = fn + ".json";
+  if (readWholeFile(jsonfn, it)) {
     blobs = make_shared< ChunkFileReader >(fn+".blobs");
     return 0;
   }
+
+  string compressed, err;
   string gzfn = jsonfn + ".gz";
-  gzFile gzfp = gzopen(gzfn.c_str(), "rb");
-  if (gzfp) {
-    it.clear();
-    while (true) {
-      char buf[8192];
-      int nr = gzread(gzfp, buf, sizeof(buf));
-      if (nr < 0) {
-        int errnum;
-        throw runtime_error(gzfn + string(": read failed: ") + string(gzerror(gzfp, &errnum)));
-      }
-      else if (nr == 0) {
-        break;
-      }
-      else {
-        it += string(&buf[0], &buf[nr]);
-      }
+  if (readWholeFile(gzfn, compressed)) {
+    if (!gunzipParallel(compressed.data(), compressed.size(), it, err, nThreads)) {
+      throw runtime_error(gzfn + string(": read failed: ") + err);
     }
+    blobs = make_shared< ChunkFileReader >(fn+".blobs");
+    return 0;
+  }
 
-    rc = gzclose(gzfp);
-    if (rc != Z_OK) {
-      throw runtime_error(gzfn + string(": close failed: ") + to_string(rc));
+#if defined(USE_ZSTD)
+  string zstfn = jsonfn + ".zst";
+  if (readWholeFile(zstfn, compressed)) {
+    if (!unzstd(compressed.data(), compressed.size(), it, err)) {
+      throw runtime_error(zstfn + string(": read failed: ") + err);
     }
     blobs = make_shared< ChunkFileReader >(fn+".blobs");
     return 0;
   }
+#endif
 
   return -1;
 }
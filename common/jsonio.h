@@ -21,6 +21,15 @@
 
 */
 
+/*
+  File formats for jsonstr::writeToFile. ZSTD needs a build with USE_ZSTD.
+*/
+enum JsonFileCompression {
+  JSON_FILE_PLAIN, // fn.json
+  JSON_FILE_GZIP, // fn.json.gz
+  JSON_FILE_ZSTD, // fn.json.zst
+};
+
 struct jsonstr {
   // WRITEME: ensure move semantics work for efficient return values
   explicit jsonstr();
@@ -52,8 +61,10 @@ struct jsonstr {
   // Read and write to files.
   // Read returns -1 with errno=ENOENT if not found.
   // Otherwise, these throw runtime errors if anything else goes wrong.
+  // Compression uses nThreads threads (0 for all cores). See compress_parallel.h
   void writeToFile(string const &fn, bool enableGzip=true) const;
-  int readFromFile(string const &fn);
+  void writeToFile(string const &fn, JsonFileCompression compression, size_t nThreads=0) const;
+  int readFromFile(string const &fn, size_t nThreads=0);
 
   string it;
   shared_ptr< ChunkFile > blobs;
@@ -73,10 +84,14 @@ bool hasNaN(jsonstr const &a);
   The high level API is asJson and fromJson
 */
 
+/*
+  With skipHintMin nonzero, large maps get skip hints. See WrJsonContext::skipHintMin.
+*/
 template <typename T>
-void toJson(jsonstr &ret, const T &value) {
+void toJson(jsonstr &ret, const T &value, size_t skipHintMin = 0) {
   WrJsonContext ctx;
   ctx.blobs = ret.blobs;
+  ctx.skipHintMin = skipHintMin;
   wrJsonSize(ctx, value);
   ctx.s = ret.startWrite(ctx.size);
   wrJson(ctx, value);
@@ -94,6 +109,7 @@ jsonstr asJson(const T &value) {
 template <typename T>
 bool fromJson(jsonstr const &sj, T &value, string &err) {
   RdJsonContext ctx(sj.it.c_str(), sj.blobs, false);
+  ctx.endStr = ctx.s + sj.it.size();
   if (!rdJson(ctx, value)) {
     err = ctx.fmtFail();
     return false;
@@ -104,6 +120,7 @@ bool fromJson(jsonstr const &sj, T &value, string &err) {
 template <typename T>
 bool fromJson(jsonstr const &sj, bool noTypeCheck, T &value, string &err) {
   RdJsonContext ctx(sj.it.c_str(), sj.blobs, noTypeCheck);
+  ctx.endStr = ctx.s + sj.it.size();
   if (!rdJson(ctx, value)) {
     err = ctx.fmtFail();
     return false;
@@ -114,6 +131,7 @@ bool fromJson(jsonstr const &sj, bool noTypeCheck, T &value, string &err) {
 template <typename T>
 bool fromJson(string const &ss, shared_ptr< ChunkFile > const &blobs, T &value, string &err) {
   RdJsonContext ctx(ss.c_str(), blobs, false);
+  ctx.endStr = ctx.s + ss.size();
   if (!rdJson(ctx, value)) {
     err = ctx.fmtFail();
     return false;
@@ -124,6 +142,7 @@ bool fromJson(string const &ss, shared_ptr< ChunkFile > const &blobs, T &value,
 template <typename T>
 bool fromJson(string const &ss, T &value, string &err) {
   RdJsonContext ctx(ss.c_str(), nullptr, false);
+  ctx.endStr = ctx.s + ss.size();
   if (!rdJson(ctx, value)) {
     err = ctx.fmtFail();
     return false;
@@ -135,6 +154,7 @@ bool fromJson(string const &ss, T &value, string &err) {
 template <typename T>
 bool fromJson(string const &ss, bool noTypeCheck, T &value, string &err) {
   RdJsonContext ctx(ss.c_str(), nullptr, noTypeCheck);
+  ctx.endStr = ctx.s + ss.size();
   if (!rdJson(ctx, value)) {
     err = ctx.fmtFail();
     return false;
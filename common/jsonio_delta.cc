@@ -0,0 +1,520 @@
+#include "tlbcore/common/std_headers.h"
+#include "./jsonio_delta.h"
+#include <unordered_map>
+
+/*
+  Spans of JSON text. Splitting containers into spans uses skipValue, so it doesn't parse
+  or allocate anything for the values.
+*/
+struct JsonSpan {
+  char const *b {nullptr};
+  char const *e {nullptr};
+  size_t size() const { return e - b; }
+};
+
+struct JsonMemberSpan {
+  JsonSpan key; // Including the quotes
+  JsonSpan value;
+};
+
+static bool spanEq(JsonSpan const &a, JsonSpan const &b)
+{
+  return a.size() == b.size() && memcmp(a.b, b.b, a.size()) == 0;
+}
+
+static JsonSpan trimSpan(string const &s)
+{
+  JsonSpan ret{s.data(), s.data() + s.size()};
+  while (ret.b < ret.e && isspace(*ret.b)) ret.b++;
+  while (ret.e > ret.b && isspace(ret.e[-1])) ret.e--;
+  return ret;
+}
+
+static bool objectMembers(JsonSpan const &obj, vector< JsonMemberSpan > &out)
+{
+  RdJsonContext ctx(obj.b, nullptr, false);
+  ctx.endStr = obj.e;
+  if (*ctx.s != '{') return false;
+  ctx.s++;
+  ctx.skipHint();
+  while (1) {
+    ctx.skipSpace();
+    if (*ctx.s == '}') break;
+    JsonMemberSpan m;
+    m.key.b = ctx.s;
+    if (*ctx.s != '"' || !ctx.skipValue()) return false;
+    m.key.e = ctx.s;
+    ctx.skipSpace();
+    if (*ctx.s != ':') return false;
+    ctx.s++;
+    ctx.skipSpace();
+    m.value.b = ctx.s;
+    if (!ctx.skipValue()) return false;
+    m.value.e = ctx.s;
+    out.push_back(m);
+    ctx.skipSpace();
+    if (*ctx.s == ',') {
+      ctx.s++;
+    }
+    else if (*ctx.s != '}') {
+      return false;
+    }
+  }
+  return ctx.s + 1 == obj.e;
+}
+
+static bool arrayElems(JsonSpan const &arr, vector< JsonSpan > &out)
+{
+  RdJsonContext ctx(arr.b, nullptr, false);
+  ctx.endStr = arr.e;
+  if (*ctx.s != '[') return false;
+  ctx.s++;
+  while (1) {
+    ctx.skipSpace();
+    if (*ctx.s == ']') break;
+    JsonSpan elem;
+    elem.b = ctx.s;
+    if (!ctx.skipValue()) return false;
+    elem.e = ctx.s;
+    out.push_back(elem);
+    ctx.skipSpace();
+    if (*ctx.s == ',') {
+      ctx.s++;
+    }
+    else if (*ctx.s != ']') {
+      return false;
+    }
+  }
+  return ctx.s + 1 == arr.e;
+}
+
+static bool decodeKey(JsonSpan const &key, string &out)
+{
+  if (!memchr(key.b, '\\', key.size())) {
+    out.assign(key.b + 1, key.e - 1);
+    return true;
+  }
+  string tmp(key.b, key.e);
+  RdJsonContext ctx(tmp.c_str(), nullptr, false);
+  return rdJson(ctx, out);
+}
+
+// A path component, with ~ and / escaped as RFC 6901 says
+static string pointerToken(string const &key)
+{
+  string ret;
+  for (char c : key) {
+    if (c == '~') {
+      ret += "~0";
+    }
+    else if (c == '/') {
+      ret += "~1";
+    }
+    else {
+      ret += c;
+    }
+  }
+  return ret;
+}
+
+
+/* ----------------------------------------------------------------------
+   Diff
+*/
+
+static void emitOp(string &out, char const *op, string const &path, JsonSpan const *value)
+{
+  if (!out.empty()) out += ',';
+  out += "{\"op\":\"";
+  out += op;
+  out += "\",\"path\":";
+  out += asJson(path).it;
+  if (value) {
+    out += ",\"value\":";
+    out.append(value->b, value->size());
+  }
+  out += '}';
+}
+
+static void diffValue(JsonSpan const &a, JsonSpan const &b, string const &path, string &out);
+
+static bool diffObjects(JsonSpan const &a, JsonSpan const &b, string const &path, string &out)
+{
+  vector< JsonMemberSpan > am, bm;
+  if (!objectMembers(a, am) || !objectMembers(b, bm)) return false;
+
+  vector< bool > used(am.size(), false);
+  unordered_map< string, size_t > aIndex; // Only built if the keys aren't in the same order
+  for (size_t bi = 0; bi < bm.size(); bi++) {
+    size_t ai = am.size();
+    if (bi < am.size() && spanEq(am[bi].key, bm[bi].key)) {
+      ai = bi;
+    }
+    else {
+      if (aIndex.empty()) {
+        for (size_t i = 0; i < am.size(); i++) {
+          aIndex[string(am[i].key.b, am[i].key.e)] = i;
+        }
+      }
+      auto it = aIndex.find(string(bm[bi].key.b, bm[bi].key.e));
+      if (it != aIndex.end()) ai = it->second;
+    }
+
+    if (ai < am.size() && spanEq(am[ai].value, bm[bi].value)) {
+      used[ai] = true;
+      continue;
+    }
+    string key;
+    if (!decodeKey(bm[bi].key, key)) return false;
+    string memberPath = path + "/" + pointerToken(key);
+    if (ai < am.size()) {
+      used[ai] = true;
+      diffValue(am[ai].value, bm[bi].value, memberPath, out);
+    } else {
+      emitOp(out, "add", memberPath, &bm[bi].value);
+    }
+  }
+  for (size_t ai = 0; ai < am.size(); ai++) {
+    if (used[ai]) continue;
+    string key;
+    if (!decodeKey(am[ai].key, key)) return false;
+    emitOp(out, "remove", path + "/" + pointerToken(key), nullptr);
+  }
+  return true;
+}
+
+static bool diffArrays(JsonSpan const &a, JsonSpan const &b, string const &path, string &out)
+{
+  vector< JsonSpan > ae, be;
+  if (!arrayElems(a, ae) || !arrayElems(b, be) || ae.size() != be.size()) return false;
+  for (size_t i = 0; i < ae.size(); i++) {
+    if (spanEq(ae[i], be[i])) continue;
+    diffValue(ae[i], be[i], path + "/" + to_string(i), out);
+  }
+  return true;
+}
+
+/*
+  Append ops turning a into b. Containers are patched piecewise only if that comes out shorter
+  than replacing them.
+*/
+static void diffValue(JsonSpan const &a, JsonSpan const &b, string const &path, string &out)
+{
+  if (spanEq(a, b)) return;
+  if (a.size() > 0 && b.size() > 0 && *a.b == *b.b && (*b.b == '{' || *b.b == '[')) {
+    string sub;
+    bool ok = (*b.b == '{') ? diffObjects(a, b, path, sub) : diffArrays(a, b, path, sub);
+    if (ok && sub.size() < b.size() + path.size() + 32) {
+      if (!out.empty() && !sub.empty()) out += ',';
+      out += sub;
+      return;
+    }
+  }
+  emitOp(out, "replace", path, &b);
+}
+
+jsonstr jsonDiff(jsonstr const &a, jsonstr const &b)
+{
+  string out;
+  JsonSpan bSpan = trimSpan(b.it);
+  if (bSpan.size() == 0) {
+    static char const nullText[] = "null";
+    bSpan = JsonSpan{nullText, nullText + 4};
+  }
+  diffValue(trimSpan(a.it), bSpan, "", out);
+  return jsonstr("[" + out + "]");
+}
+
+bool jsonPatchIsEmpty(jsonstr const &patch)
+{
+  JsonSpan s = trimSpan(patch.it);
+  vector< JsonSpan > ops;
+  return arrayElems(s, ops) && ops.empty();
+}
+
+
+/* ----------------------------------------------------------------------
+   Patch
+*/
+
+/*
+  A document being patched. Nodes hold their original text until a path goes through them,
+  then get expanded into children. Writing them out copies unexpanded text verbatim.
+*/
+struct JsonPatchNode {
+  explicit JsonPatchNode(JsonSpan const &span)
+    :text(span.b, span.e)
+  {
+  }
+
+  bool expand()
+  {
+    if (expanded) return true;
+    JsonSpan span{text.data(), text.data() + text.size()};
+    if (!text.empty() && text[0] == '{') {
+      vector< JsonMemberSpan > members;
+      if (!objectMembers(span, members)) return false;
+      isObject = true;
+      for (auto &m : members) {
+        string key;
+        if (!decodeKey(m.key, key)) return false;
+        keys.push_back(key);
+        keyTexts.emplace_back(m.key.b, m.key.e);
+        children.push_back(make_unique< JsonPatchNode >(m.value));
+      }
+    }
+    else if (!text.empty() && text[0] == '[') {
+      vector< JsonSpan > elems;
+      if (!arrayElems(span, elems)) return false;
+      for (auto &e : elems) {
+        children.push_back(make_unique< JsonPatchNode >(e));
+      }
+    }
+    else {
+      return false;
+    }
+    expanded = true;
+    text.clear();
+    return true;
+  }
+
+  void write(string &out) const
+  {
+    if (!expanded) {
+      out += text;
+      return;
+    }
+    out += isObject ? '{' : '[';
+    for (size_t i = 0; i < children.size(); i++) {
+      if (i) out += ',';
+      if (isObject) {
+        out += keyTexts[i];
+        out += ':';
+      }
+      children[i]->write(out);
+    }
+    out += isObject ? '}' : ']';
+  }
+
+  string text;
+  bool expanded {false};
+  bool isObject {false};
+  vector< string > keys; // Decoded, for matching paths
+  vector< string > keyTexts; // As JSON
+  vector< unique_ptr< JsonPatchNode > > children;
+};
+
+static bool splitPointer(string const &path, vector< string > &tokens)
+{
+  if (path.empty()) return true;
+  if (path[0] != '/') return false;
+  string cur;
+  for (size_t i = 1; i <= path.size(); i++) {
+    if (i == path.size() || path[i] == '/') {
+      tokens.push_back(cur);
+      cur.clear();
+    }
+    else if (path[i] == '~' && i + 1 < path.size() && (path[i+1] == '0' || path[i+1] == '1')) {
+      cur += path[i+1] == '0' ? '~' : '/';
+      i++;
+    }
+    else {
+      cur += path[i];
+    }
+  }
+  return true;
+}
+
+static bool parseIndex(string const &tok, size_t limit, size_t &index)
+{
+  if (tok.empty() || tok.size() > 18) return false;
+  for (char c : tok) {
+    if (!isdigit(c)) return false;
+  }
+  if (tok.size() > 1 && tok[0] == '0') return false;
+  index = (size_t)strtoull(tok.c_str(), nullptr, 10);
+  return index <= limit;
+}
+
+static bool applyOp(unique_ptr< JsonPatchNode > &root, string const &op, string const &path, JsonSpan const &value, bool hasValue, string &err)
+{
+  vector< string > tokens;
+  if (!splitPointer(path, tokens)) {
+    err = "bad path " + path;
+    return false;
+  }
+  if ((op == "add" || op == "replace") && !hasValue) {
+    err = op + " without value";
+    return false;
+  }
+  if (tokens.empty()) {
+    if (op == "remove") {
+      err = "can't remove the root";
+      return false;
+    }
+    root = make_unique< JsonPatchNode >(value);
+    return true;
+  }
+
+  JsonPatchNode *parent = root.get();
+  for (size_t ti = 0; ti + 1 < tokens.size(); ti++) {
+    if (!parent->expand()) {
+      err = "path goes through a scalar: " + path;
+      return false;
+    }
+    size_t ci = parent->children.size();
+    if (parent->isObject) {
+      for (size_t i = 0; i < parent->keys.size(); i++) {
+        if (parent->keys[i] == tokens[ti]) ci = i;
+      }
+    }
+    else if (!parseIndex(tokens[ti], parent->children.size(), ci)) {
+      ci = parent->children.size();
+    }
+    if (ci >= parent->children.size()) {
+      err = "no such path " + path;
+      return false;
+    }
+    parent = parent->children[ci].get();
+  }
+
+  if (!parent->expand()) {
+    err = "path goes through a scalar: " + path;
+    return false;
+  }
+  string const &last = tokens.back();
+  if (parent->isObject) {
+    size_t ci = parent->keys.size();
+    for (size_t i = 0; i < parent->keys.size(); i++) {
+      if (parent->keys[i] == last) ci = i;
+    }
+    if (op == "remove") {
+      if (ci == parent->keys.size()) {
+        err = "no such member " + path;
+        return false;
+      }
+      parent->keys.erase(parent->keys.begin() + ci);
+      parent->keyTexts.erase(parent->keyTexts.begin() + ci);
+      parent->children.erase(parent->children.begin() + ci);
+    }
+    else if (ci < parent->keys.size()) {
+      parent->children[ci] = make_unique< JsonPatchNode >(value);
+    }
+    else if (op == "add") {
+      parent->keys.push_back(last);
+      parent->keyTexts.push_back(asJson(last).it);
+      parent->children.push_back(make_unique< JsonPatchNode >(value));
+    }
+    else {
+      err = "no such member " + path;
+      return false;
+    }
+  }
+  else {
+    size_t n = parent->children.size();
+    size_t index = n;
+    if (!(op == "add" && last == "-") && !parseIndex(last, n, index)) {
+      err = "bad array index " + path;
+      return false;
+    }
+    if (op == "add") {
+      parent->children.insert(parent->children.begin() + index, make_unique< JsonPatchNode >(value));
+    }
+    else if (index >= n) {
+      err = "array index out of range " + path;
+      return false;
+    }
+    else if (op == "remove") {
+      parent->children.erase(parent->children.begin() + index);
+    }
+    else {
+      parent->children[index] = make_unique< JsonPatchNode >(value);
+    }
+  }
+  return true;
+}
+
+bool jsonPatch(jsonstr &target, jsonstr const &patch, string &err)
+{
+  vector< JsonSpan > ops;
+  if (!arrayElems(trimSpan(patch.it), ops)) {
+    err = "patch isn't an array";
+    return false;
+  }
+  if (ops.empty()) return true;
+
+  auto root = make_unique< JsonPatchNode >(trimSpan(target.it));
+  for (auto &opSpan : ops) {
+    vector< JsonMemberSpan > members;
+    if (!objectMembers(opSpan, members)) {
+      err = "patch op isn't an object";
+      return false;
+    }
+    string op, path;
+    JsonSpan value;
+    bool hasValue = false;
+    for (auto &m : members) {
+      string key;
+      if (!decodeKey(m.key, key)) {
+        err = "bad key in patch op";
+        return false;
+      }
+      string mvalue(m.value.b, m.value.e);
+      RdJsonContext ctx(mvalue.c_str(), nullptr, false);
+      if (key == "op") {
+        if (!rdJson(ctx, op)) {
+          err = "bad op";
+          return false;
+        }
+      }
+      else if (key == "path") {
+        if (!rdJson(ctx, path)) {
+          err = "bad path";
+          return false;
+        }
+      }
+      else if (key == "value") {
+        value = m.value;
+        hasValue = true;
+      }
+    }
+    if (op != "add" && op != "replace" && op != "remove") {
+      err = "unsupported op " + op;
+      return false;
+    }
+    if (!applyOp(root, op, path, value, hasValue, err)) return false;
+  }
+
+  string out;
+  out.reserve(target.it.size());
+  root->write(out);
+  target.it = std::move(out);
+  return true;
+}
+
+
+/* ----------------------------------------------------------------------
+   JsonDeltaEncoder
+*/
+
+jsonstr JsonDeltaEncoder::update(jsonstr const &cur)
+{
+  jsonstr ret;
+  if (havePrev) {
+    ret = jsonDiff(prev, cur);
+  } else {
+    JsonSpan span = trimSpan(cur.it);
+    string out;
+    emitOp(out, "replace", "", &span);
+    ret = jsonstr("[" + out + "]");
+  }
+  prev = cur;
+  havePrev = true;
+  return ret;
+}
+
+void JsonDeltaEncoder::reset()
+{
+  prev.setNull();
+  havePrev = false;
+}
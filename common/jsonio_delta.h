@@ -0,0 +1,46 @@
+#pragma once
+#include "./jsonio.h"
+
+/*
+  Delta encoding for JSON state that gets serialized over and over, like the state we push to
+  browser clients every tick.
+
+  jsonDiff compares two serializations and returns a patch in a subset of JSON Patch (RFC 6902):
+    [{"op":"replace","path":"/robot/pos/1","value":2.5},{"op":"remove","path":"/old"},...]
+  using only add, replace and remove. Objects are compared member by member, and arrays of
+  the same length element by element. It only descends into values whose text differs, and
+  replaces a container whole when that's shorter than patching it. So after the memcmp-speed
+  scan of both texts, the work and the patch size scale with what changed.
+
+  jsonPatch applies a patch to a jsonstr. It only expands the containers on the paths it
+  touches, and copies everything else verbatim. Any RFC 6902 implementation can apply the same
+  patches in JS.
+
+  JsonDeltaEncoder remembers the last state sent:
+    JsonDeltaEncoder enc;
+    ...every tick:
+      jsonstr patch = enc.update(state);
+      if (!jsonPatchIsEmpty(patch)) send(patch);
+  The first update returns a patch replacing the whole document.
+
+  Blobs aren't diffed. ndarray members just compare by their offsets.
+*/
+
+jsonstr jsonDiff(jsonstr const &a, jsonstr const &b);
+bool jsonPatch(jsonstr &target, jsonstr const &patch, string &err);
+bool jsonPatchIsEmpty(jsonstr const &patch);
+
+struct JsonDeltaEncoder {
+  jsonstr update(jsonstr const &cur);
+
+  template<typename T>
+  jsonstr update(T const &state)
+  {
+    return update(asJson(state));
+  }
+
+  void reset();
+
+  jsonstr prev;
+  bool havePrev {false};
+};
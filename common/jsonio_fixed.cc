@@ -0,0 +1,36 @@
+#include "tlbcore/common/std_headers.h"
+#include "./jsonio_fixed.h"
+
+bool jsonFixedSchemaMembers(jsonstr const &schema, string &typeName, vector< string > &memberNames, string &err)
+{
+  map< string, jsonstr > top;
+  if (!fromJson(schema, top, err)) return false;
+
+  auto typeNameIt = top.find("typename");
+  if (typeNameIt == top.end()) {
+    err = "no typename";
+    return false;
+  }
+  if (!fromJson(typeNameIt->second, typeName, err)) return false;
+
+  auto membersIt = top.find("members");
+  if (membersIt == top.end()) {
+    err = "no members in " + typeName;
+    return false;
+  }
+  vector< map< string, jsonstr > > members;
+  if (!fromJson(membersIt->second, members, err)) return false;
+
+  memberNames.clear();
+  for (auto &member : members) {
+    auto nameIt = member.find("memberName");
+    if (nameIt == member.end()) {
+      err = "member with no memberName in " + typeName;
+      return false;
+    }
+    string memberName;
+    if (!fromJson(nameIt->second, memberName, err)) return false;
+    memberNames.push_back(memberName);
+  }
+  return true;
+}
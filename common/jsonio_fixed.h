@@ -0,0 +1,210 @@
+#pragma once
+#include <tuple>
+#include "./jsonio.h"
+
+/*
+  Fixed-key-order JSON codecs for structs.
+
+  Almost all the JSON we read was written by wrJson, so the keys arrive in the order the
+  schema (see addSchemas) lists them. A JsonFixedCodec knows that order ahead of time. It
+  precomputes the literal text between values, e.g. {"__type":"Foo","a": then ,"b": and so on,
+  so that reading checks each key with one compare and goes straight to the member's rdJson.
+  If anything doesn't match (whitespace, different order, extra or missing keys), readFast
+  puts ctx.s back and returns false, and the caller falls back to its general reader.
+  writeSize and write produce the same canonical form, so a type's wrJsonSize and wrJson can
+  just call them.
+
+  Build one per type from its schema, naming the member each key reads into:
+
+    static auto fooCodec = mkJsonFixedCodecFromSchema< Foo >(
+      jsonFixedField("b", &Foo::b), jsonFixedField("a", &Foo::a));
+
+  The type name and key order come from getSchema(Foo()), so the fields can be listed in any
+  order. The schema is the JSON getSchema returns, and addSchemas stores by type name:
+    {"typename":"Foo", "members":[{"memberName":"a", ...}, {"memberName":"b", ...}], ...}
+  Only typename and the memberNames are used. The constructor throws runtime_error if the
+  schema can't be read, or its members and the fields don't match one for one. So the field
+  list can't silently drift from the schema.
+
+  For a type with no schema, give the type name and list the fields in the order to write them:
+
+    static auto barCodec = mkJsonFixedCodec< Bar >("Bar", jsonFixedField("x", &Bar::x));
+
+  typeName may be nullptr for types written without a __type member.
+
+  The member calls are unqualified, so each member's codec functions are found by ADL even
+  when they're declared after this header.
+*/
+
+template<typename C, typename M>
+struct JsonFixedField {
+  char const *name;
+  M C::*member;
+};
+
+template<typename C, typename M>
+JsonFixedField< C, M > jsonFixedField(char const *name, M C::*member)
+{
+  return JsonFixedField< C, M >{name, member};
+}
+
+/*
+  Read the type name and member names, in order, from a schema as above.
+*/
+bool jsonFixedSchemaMembers(jsonstr const &schema, string &typeName, vector< string > &memberNames, string &err);
+
+template<typename C, typename... Fields>
+struct JsonFixedCodec {
+
+  explicit JsonFixedCodec(char const *typeName, Fields... _fields)
+    :fields(_fields...)
+  {
+    vector< size_t > order;
+    for (size_t i = 0; i < sizeof...(Fields); i++) order.push_back(i);
+    setup(typeName, order);
+  }
+
+  JsonFixedCodec(jsonstr const &schema, Fields... _fields)
+    :fields(_fields...)
+  {
+    string typeName, err;
+    vector< string > memberNames;
+    if (!jsonFixedSchemaMembers(schema, typeName, memberNames, err)) {
+      throw runtime_error("JsonFixedCodec: bad schema: " + err);
+    }
+    vector< char const * > names {_fields.name...};
+    if (memberNames.size() != names.size()) {
+      throw runtime_error("JsonFixedCodec: " + typeName + " has " + to_string(memberNames.size()) +
+                          " members in its schema but " + to_string(names.size()) + " fields");
+    }
+    vector< size_t > order;
+    vector< bool > used(names.size(), false);
+    for (auto const &memberName : memberNames) {
+      size_t fi = 0;
+      while (fi < names.size() && (used[fi] || memberName != names[fi])) fi++;
+      if (fi == names.size()) {
+        throw runtime_error("JsonFixedCodec: no field for " + typeName + "." + memberName);
+      }
+      used[fi] = true;
+      order.push_back(fi);
+    }
+    setup(typeName.c_str(), order);
+  }
+
+  /*
+    Fields are visited in key order, which may not be the order they were given in, so each
+    gets a small table of functions indexed by its position in the tuple.
+  */
+  struct FieldOps {
+    void (*writeSize)(JsonFixedCodec const &codec, WrJsonContext &ctx, C const &it);
+    void (*write)(JsonFixedCodec const &codec, WrJsonContext &ctx, C const &it);
+    bool (*read)(JsonFixedCodec const &codec, RdJsonContext &ctx, C &it);
+  };
+
+  void setup(char const *typeName, vector< size_t > const &order)
+  {
+    string head = "{";
+    if (typeName) {
+      head += string("\"__type\":\"") + typeName + "\"";
+    }
+    auto allOps = mkFieldOps(std::index_sequence_for< Fields... >());
+    auto allNames = fieldNames(std::index_sequence_for< Fields... >());
+    for (size_t i = 0; i < order.size(); i++) {
+      prefixes.push_back((i == 0 ? head + (typeName ? "," : "") : string(",")) + "\"" + allNames[order[i]] + "\":");
+      ops.push_back(allOps[order[i]]);
+    }
+    if (order.empty()) prefixes.push_back(head);
+  }
+
+  void writeSize(WrJsonContext &ctx, C const &it) const
+  {
+    for (auto &p : prefixes) ctx.size += p.size();
+    ctx.size += 1;
+    for (auto &op : ops) op.writeSize(*this, ctx, it);
+  }
+
+  void write(WrJsonContext &ctx, C const &it) const
+  {
+    if (ops.empty()) ctx.emit(prefixes[0].c_str());
+    for (size_t i = 0; i < ops.size(); i++) {
+      ctx.emit(prefixes[i].c_str());
+      ops[i].write(*this, ctx, it);
+    }
+    *ctx.s++ = '}';
+  }
+
+  bool readFast(RdJsonContext &ctx, C &it) const
+  {
+    char const *start = ctx.s;
+    ctx.skipSpace();
+    bool ok = true;
+    if (ops.empty()) ok = matchPrefix(ctx, 0);
+    for (size_t i = 0; ok && i < ops.size(); i++) {
+      ok = matchPrefix(ctx, i) && ops[i].read(*this, ctx, it);
+    }
+    if (ok && *ctx.s == '}') {
+      ctx.s++;
+      return true;
+    }
+    ctx.s = start;
+    return false;
+  }
+
+  /*
+    strncmp rather than memcmp, since it stops at the terminating NUL of the input if the
+    input is shorter than the prefix.
+  */
+  bool matchPrefix(RdJsonContext &ctx, size_t i) const
+  {
+    auto const &p = prefixes[i];
+    if (strncmp(ctx.s, p.data(), p.size()) != 0) return false;
+    ctx.s += p.size();
+    return true;
+  }
+
+  template<size_t I>
+  static void writeSizeField(JsonFixedCodec const &codec, WrJsonContext &ctx, C const &it)
+  {
+    wrJsonSize(ctx, it.*(std::get< I >(codec.fields).member));
+  }
+
+  template<size_t I>
+  static void writeField(JsonFixedCodec const &codec, WrJsonContext &ctx, C const &it)
+  {
+    wrJson(ctx, it.*(std::get< I >(codec.fields).member));
+  }
+
+  template<size_t I>
+  static bool readField(JsonFixedCodec const &codec, RdJsonContext &ctx, C &it)
+  {
+    return rdJson(ctx, it.*(std::get< I >(codec.fields).member));
+  }
+
+  template<size_t... Is>
+  static vector< FieldOps > mkFieldOps(std::index_sequence< Is... >)
+  {
+    return vector< FieldOps > {FieldOps{&writeSizeField< Is >, &writeField< Is >, &readField< Is >}...};
+  }
+
+  template<size_t... Is>
+  vector< char const * > fieldNames(std::index_sequence< Is... >) const
+  {
+    return vector< char const * > {std::get< Is >(fields).name...};
+  }
+
+  std::tuple< Fields... > fields;
+  vector< string > prefixes; // In key order
+  vector< FieldOps > ops; // In key order
+};
+
+template<typename C, typename... Ms>
+JsonFixedCodec< C, JsonFixedField< C, Ms >... > mkJsonFixedCodec(char const *typeName, JsonFixedField< C, Ms >... fields)
+{
+  return JsonFixedCodec< C, JsonFixedField< C, Ms >... >(typeName, fields...);
+}
+
+template<typename C, typename... Ms>
+JsonFixedCodec< C, JsonFixedField< C, Ms >... > mkJsonFixedCodecFromSchema(JsonFixedField< C, Ms >... fields)
+{
+  return JsonFixedCodec< C, JsonFixedField< C, Ms >... >(jsonstr(getSchema(C())), fields...);
+}
@@ -2,6 +2,9 @@
 #include "./jsonio.h"
 #include <cxxabi.h>
 #include <typeindex>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /* ----------------------------------------------------------------------
    Low-level json stuff
@@ -73,51 +76,167 @@ void RdJsonContext::skipSpace() {
   }
 }
 
+/*
+  Scanning for the chars that matter when skipping. With SSE2 we look at 16 bytes at a time.
+  The loads are aligned, so they never cross into an unmapped page even though they may read
+  past the terminating NUL.
+*/
+#if defined(__SSE2__)
+static inline U32 structuralMask(__m128i v)
+{
+  // '[' | 0x20 == '{' and ']' | 0x20 == '}', and no other chars map to those
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i m = _mm_or_si128(
+    _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+  return (U32)_mm_movemask_epi8(m);
+}
+
+static inline U32 stringSpecialMask(__m128i v)
+{
+  __m128i m = _mm_or_si128(
+    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+    _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+  return (U32)_mm_movemask_epi8(m);
+}
+
+template<U32 (*MASK)(__m128i)>
+static inline char const *findFirst(char const *p)
+{
+  uintptr_t mis = (uintptr_t)p & 15;
+  __m128i const *a = reinterpret_cast< __m128i const * >(p - mis);
+  U32 m = MASK(_mm_load_si128(a)) & (0xffffu << mis);
+  while (!m) {
+    a++;
+    m = MASK(_mm_load_si128(a));
+  }
+  return reinterpret_cast< char const * >(a) + __builtin_ctz(m);
+}
+#endif
+
+// The next quote, bracket, brace or NUL
+static inline char const *findStructural(char const *p)
+{
+#if defined(__SSE2__)
+  return findFirst< structuralMask >(p);
+#else
+  while (1) {
+    char c = *p;
+    if (c == '"' || c == '[' || c == ']' || c == '{' || c == '}' || c == 0) return p;
+    p++;
+  }
+#endif
+}
+
+// The next quote, backslash or NUL
+static inline char const *findStringSpecial(char const *p)
+{
+#if defined(__SSE2__)
+  return findFirst< stringSpecialMask >(p);
+#else
+  while (1) {
+    char c = *p;
+    if (c == '"' || c == '\\' || c == 0) return p;
+    p++;
+  }
+#endif
+}
+
+/*
+  With p pointing at an opening quote, return the pointer past the closing quote, or nullptr
+  if the string isn't terminated.
+*/
+static char const *skipString(char const *p)
+{
+  p++;
+  while (1) {
+    p = findStringSpecial(p);
+    if (*p == '"') return p + 1;
+    if (*p == 0 || p[1] == 0) return nullptr;
+    p += 2; // Backslash and the escaped char
+  }
+}
+
+static char const skipHintPrefix[] = "{\"__skip\":";
+static size_t const skipHintPrefixLen = sizeof(skipHintPrefix) - 1;
+static size_t const skipHintDigits = 10; // The width of the slot WrJsonContext::beginSkipHint reserves
+
+/*
+  Only accept exactly what endSkipHint leaves: the length left-justified in the space-padded slot,
+  then a comma, and the length landing on a }. So a real "__skip" member, as in {"__skip":"x"}
+  or {"__skip":5,...}, isn't mistaken for a hint.
+*/
+char const *RdJsonContext::hintEnd(char const *p) const
+{
+  if (!endStr || (size_t)(endStr - p) < skipHintPrefixLen + skipHintDigits + 1) return nullptr;
+  if (p[1] != '"' || strncmp(p, skipHintPrefix, skipHintPrefixLen) != 0) return nullptr;
+  char const *digits = p + skipHintPrefixLen;
+  size_t n = 0, i = 0;
+  while (i < skipHintDigits && isdigit(digits[i])) {
+    n = n * 10 + (digits[i] - '0');
+    i++;
+  }
+  if (i == 0) return nullptr;
+  while (i < skipHintDigits && digits[i] == ' ') i++;
+  if (i != skipHintDigits || digits[skipHintDigits] != ',') return nullptr;
+  if (n <= skipHintPrefixLen + skipHintDigits + 2 || n > (size_t)(endStr - p) || p[n - 1] != '}') return nullptr;
+  return p + n;
+}
+
+void RdJsonContext::skipHint()
+{
+  // beginSkipHint puts the hint right after the {, which the caller just stepped over
+  if (hintEnd(s - 1)) s += skipHintPrefixLen - 1 + skipHintDigits + 1;
+}
+
 bool RdJsonContext::skipValue() {
   skipSpace();
-  if (*s == '\"') {
-    string tmp;
-    shared_ptr< ChunkFile > blobs;
-    rdJson(*this, tmp);
+  char c = *s;
+  if (c == '"') {
+    char const *p = skipString(s);
+    if (!p) return false;
+    s = p;
   }
-  else if (*s == '[') {
-    s++;
-    skipSpace();
+  else if (c == '[' || c == '{') {
+    // Only brackets and strings matter, since commas, colons and scalars don't change the nesting
+    char const *p = s;
+    int depth = 0;
     while (1) {
-      if (*s == ',') {
-        s++;
-      }
-      else if (*s == ']') {
-        s++;
-        break;
-      }
-      else {
-        if (!skipValue()) return false;
+      p = findStructural(p);
+      char pc = *p;
+      if (pc == '"') {
+        p = skipString(p);
+        if (!p) return false;
+        continue;
       }
-    }
-  }
-  else if (*s == '{') {
-    s++;
-    skipSpace();
-    while (1) {
-      if (*s == ',') {
-        s++;
+      else if (pc == '{') {
+        char const *end = hintEnd(p);
+        if (end) {
+          p = end;
+          if (depth == 0) break;
+          continue;
+        }
+        depth++;
       }
-      else if (*s == ':') {
-        s++;
+      else if (pc == '[') {
+        depth++;
       }
-      else if (*s == '}') {
-        s++;
-        break;
+      else if (pc == ']' || pc == '}') {
+        if (--depth == 0) {
+          p++;
+          break;
+        }
       }
       else {
-        if (!skipValue()) return false;
+        return false; // NUL
       }
+      p++;
     }
+    s = p;
   }
-  else if (isalnum(*s) || *s=='.' || *s == '-') {
+  else if (isalnum(c) || c == '.' || c == '-') {
     s++;
-    while (isalnum(*s) || *s=='.' || *s == '-') s++;
+    while (isalnum(*s) || *s == '.' || *s == '-') s++;
   }
   else {
     return false;
@@ -129,8 +248,9 @@ bool RdJsonContext::skipValue() {
 bool RdJsonContext::skipMember() {
   skipSpace();
   if (*s == '\"') {
-    string tmp;
-    rdJson(*this, tmp);
+    char const *p = skipString(s);
+    if (!p) return false;
+    s = p;
     skipSpace();
     if (*s == ':') {
       s++;
@@ -142,6 +262,52 @@ bool RdJsonContext::skipMember() {
   return false;
 }
 
+size_t RdJsonContext::countArrayElems() const
+{
+  char const *p = s;
+  if (*p != '[') return 0;
+  p++;
+  size_t count = 0;
+  int depth = 1;
+  bool expectElem = true;
+  while (depth > 0) {
+    char c = *p++;
+    switch (c) {
+      case 0:
+        return count; // Truncated. The real parse will report it
+      case ' ': case '\t': case '\n': case '\r':
+        continue;
+      case '"':
+        while (*p && *p != '"') {
+          if (*p == '\\' && p[1]) p++;
+          p++;
+        }
+        if (*p) p++;
+        break;
+      case '[': case '{':
+        depth++;
+        break;
+      case ']': case '}':
+        depth--;
+        if (depth == 0) return count;
+        break;
+      case ',':
+        if (depth == 1) {
+          expectElem = true;
+          continue;
+        }
+        break;
+    }
+    if (depth == 1 || (depth == 2 && (c == '[' || c == '{'))) {
+      if (expectElem) {
+        count++;
+        expectElem = false;
+      }
+    }
+  }
+  return count;
+}
+
 bool RdJsonContext::match(char const *pattern)
 {
   skipSpace();
@@ -201,6 +367,32 @@ bool RdJsonContext::matchKey(char const *pattern)
 }
 
 
+char *WrJsonContext::beginSkipHint()
+{
+  if (!skipHintMin) return nullptr;
+  char *mark = s;
+  memcpy(s, "\"__skip\":          ,", 20);
+  s += 20;
+  return mark;
+}
+
+void WrJsonContext::endSkipHint(char *mark)
+{
+  if (!mark) return;
+  char *body = mark + 20;
+  size_t total = s - (mark - 1);
+  if (s - body <= 1 || total < skipHintMin) {
+    // Empty or small. Take the hint back out
+    memmove(mark, body, s - body);
+    s -= 20;
+    return;
+  }
+  // Left-justified in the space, so it's followed by spaces which JSON allows before the comma
+  char digits[24];
+  int nDigits = snprintf(digits, sizeof(digits), "%zu", total);
+  memcpy(mark + 9, digits, nDigits);
+}
+
 void WrJsonContext::emit(char const *str)
 {
   while (*str) {
@@ -7,6 +7,7 @@ struct RdJsonContext {
 
   char const *fullStr {nullptr};
   char const *s {nullptr};
+  char const *endStr {nullptr}; // If known. Needed to trust skip hints
   shared_ptr<ChunkFile> blobs;
   bool noTypeCheck {false};
 
@@ -23,10 +24,28 @@ struct RdJsonContext {
 
   /*
     Skip past a value or member of an object, ie "foo":123,
+    Containers are skipped by matching brackets and quotes without parsing or allocating
+    anything, and objects with a skip hint (see WrJsonContext::skipHintMin) are jumped over.
   */
   bool skipValue();
   bool skipMember();
 
+  /*
+    Readers of objects call this just after the {, to step over a skip hint if there is one.
+    hintEnd returns the end of the object at p according to its hint, or nullptr if it has no
+    usable hint. Both only recognize the exact form endSkipHint writes, and only when endStr
+    is known, so a real "__skip" key is read as an ordinary member.
+  */
+  void skipHint();
+  char const *hintEnd(char const *p) const;
+
+  /*
+    With s pointing at a [, count the elements of the array without parsing them or moving s.
+    It only looks at structure (brackets, commas and strings), so it's much faster than
+    parsing. Readers use it to size their storage once before parsing in place.
+  */
+  size_t countArrayElems() const;
+
   /*
     If the pattern matches, advance s past it and return true. Otherwise leave s the same and return false.
     jsonMatchKey matches "pattern":
@@ -41,5 +60,22 @@ struct WrJsonContext {
   size_t size {0};
   shared_ptr<ChunkFile> blobs;
 
+  /*
+    When nonzero, maps whose JSON comes to at least skipHintMin bytes start with a "__skip":N
+    member, where N is the length of the object's text from { through }. Readers that only want
+    to skip the object (rdJson of a jsonstr, or skipping unknown members) can then jump straight
+    over it.
+    Our map readers ignore the member, but other JSON consumers will see it as a key, so only
+    turn it on for data read back by tlbcore.
+
+    Object writers call beginSkipHint after the { and endSkipHint after the }, and add
+    skipHintSize() to the size estimate. endSkipHint removes the hint again if the object
+    turned out small or empty.
+  */
+  size_t skipHintMin {0};
+  size_t skipHintSize() const { return skipHintMin ? 20 : 0; }
+  char *beginSkipHint();
+  void endSkipHint(char *mark);
+
   void emit(char const *str);
 };
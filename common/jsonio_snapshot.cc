@@ -0,0 +1,185 @@
+#include "tlbcore/common/std_headers.h"
+#include "./jsonio_snapshot.h"
+#include <sys/stat.h>
+#include <future>
+#include <thread>
+
+// The manifest is fn.snapshot.json, written and read as a jsonstr file named fn.snapshot
+static string manifestName(string const &fn)
+{
+  return fn + ".snapshot";
+}
+
+static string dirName(string const &fn)
+{
+  auto slash = fn.rfind('/');
+  if (slash == string::npos) return ".";
+  if (slash == 0) return "/";
+  return fn.substr(0, slash);
+}
+
+static bool fileExists(string const &fn)
+{
+  struct stat st;
+  return stat(fn.c_str(), &st) == 0;
+}
+
+static void fsyncPath(string const &fn, bool isDir)
+{
+  int fd = open(fn.c_str(), isDir ? (O_RDONLY | O_DIRECTORY) : O_RDONLY);
+  if (fd < 0) {
+    throw runtime_error(fn + string(": ") + string(strerror(errno)));
+  }
+  if (fsync(fd) < 0) {
+    int err = errno;
+    close(fd);
+    throw runtime_error(fn + string(": fsync: ") + string(strerror(err)));
+  }
+  close(fd);
+}
+
+static void removeIfExists(string const &fn)
+{
+  if (unlink(fn.c_str()) < 0 && errno != ENOENT) {
+    throw runtime_error(fn + string(": ") + string(strerror(errno)));
+  }
+}
+
+static string jsonFileSuffix(JsonFileCompression compression)
+{
+  switch (compression) {
+  case JSON_FILE_GZIP: return ".json.gz";
+  case JSON_FILE_ZSTD: return ".json.zst";
+  default: return ".json";
+  }
+}
+
+
+JsonSnapshotWriter::JsonSnapshotWriter(string const &_fn, JsonFileCompression _compression, size_t _nThreads)
+  :fn(_fn),
+   compression(_compression),
+   nThreads(_nThreads)
+{
+}
+
+JsonSnapshotWriter::~JsonSnapshotWriter()
+{
+  {
+    unique_lock< mutex > lock(jobsMutex);
+    stopping = true;
+    jobsCv.notify_one();
+  }
+  if (worker.joinable()) worker.join();
+}
+
+void JsonSnapshotWriter::enqueue(packaged_task< void() > &&job)
+{
+  unique_lock< mutex > lock(jobsMutex);
+  jobs.push_back(std::move(job));
+  if (!worker.joinable()) {
+    worker = thread([this]() { work(); });
+  }
+  jobsCv.notify_one();
+}
+
+void JsonSnapshotWriter::work()
+{
+  while (1) {
+    packaged_task< void() > job;
+    {
+      unique_lock< mutex > lock(jobsMutex);
+      jobsCv.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      // Finish the queue even when stopping, since the caller may be waiting on the futures
+      if (jobs.empty()) return;
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job(); // Exceptions go to the job's future
+  }
+}
+
+shared_ptr< ChunkFileCompressed > JsonSnapshotWriter::beginWrite(jsonstr &js)
+{
+  recoverJsonSnapshot(fn);
+  string tmp = fn + ".tmp";
+  for (auto compression1 : {JSON_FILE_PLAIN, JSON_FILE_GZIP, JSON_FILE_ZSTD}) {
+    removeIfExists(tmp + jsonFileSuffix(compression1));
+  }
+  auto blobs = make_shared< ChunkFileCompressed >(tmp + ".blobs");
+  js.blobs = blobs;
+  return blobs;
+}
+
+void JsonSnapshotWriter::finishWrite(jsonstr &js, shared_ptr< ChunkFileCompressed > &blobs)
+{
+  string tmp = fn + ".tmp";
+  js.blobs = nullptr;
+  if (!blobs->close()) {
+    throw runtime_error(tmp + ".blobs.gz: write failed");
+  }
+  js.writeToFile(tmp, compression, nThreads);
+
+  string suffix = jsonFileSuffix(compression);
+  fsyncPath(tmp + suffix, false);
+  fsyncPath(tmp + ".blobs.gz", false);
+
+  /*
+    The manifest maps each final name to the temp file to rename onto it, or to "" to remove it.
+    Removing the other json variants matters, since readFromFile would prefer a stale fn.json
+    over a new fn.json.gz.
+  */
+  map< string, string > ops;
+  ops[fn + suffix] = tmp + suffix;
+  ops[fn + ".blobs.gz"] = tmp + ".blobs.gz";
+  ops[fn + ".blobs"] = "";
+  for (auto compression1 : {JSON_FILE_PLAIN, JSON_FILE_GZIP, JSON_FILE_ZSTD}) {
+    if (compression1 != compression) ops[fn + jsonFileSuffix(compression1)] = "";
+  }
+  jsonstr manifest = asJson(ops);
+  string manifestTmp = manifestName(fn) + ".tmp";
+  manifest.writeToFile(manifestTmp, false);
+  fsyncPath(manifestTmp + ".json", false);
+  if (rename((manifestTmp + ".json").c_str(), (manifestName(fn) + ".json").c_str()) < 0) {
+    throw runtime_error(manifestName(fn) + string(".json: ") + string(strerror(errno)));
+  }
+  fsyncPath(dirName(fn), true);
+
+  recoverJsonSnapshot(fn);
+}
+
+
+bool recoverJsonSnapshot(string const &fn)
+{
+  string mfn = manifestName(fn);
+  jsonstr manifest;
+  if (manifest.readFromFile(mfn) < 0) return false;
+
+  map< string, string > ops;
+  string err;
+  if (!fromJson(manifest, ops, err)) {
+    // A manifest is only renamed into place after it's fsynced, so someone else wrote this.
+    // Don't guess.
+    throw runtime_error(mfn + string(".json: ") + err);
+  }
+
+  for (auto &it : ops) {
+    if (it.second.empty()) {
+      removeIfExists(it.first);
+    }
+    else if (fileExists(it.second)) {
+      if (rename(it.second.c_str(), it.first.c_str()) < 0) {
+        throw runtime_error(it.first + string(": ") + string(strerror(errno)));
+      }
+    }
+    // Else it was renamed before the crash
+  }
+  fsyncPath(dirName(fn), true);
+  removeIfExists(mfn + ".json");
+  return true;
+}
+
+int readJsonSnapshot(string const &fn, jsonstr &js, size_t nThreads)
+{
+  recoverJsonSnapshot(fn);
+  return js.readFromFile(fn, nThreads);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <future>
+#include <thread>
+#include <condition_variable>
+#include "./jsonio.h"
+
+/*
+  Crash-safe snapshots of a value with its blobs, written in the background.
+
+  A snapshot named fn is the usual pair, fn.json.gz (or .json.zst, or .json) and fn.blobs.gz,
+  so jsonstr::readFromFile(fn) reads it. JsonSnapshotWriter::write serializes into fn.tmp.*
+  on another thread, fsyncs, then commits the pair with a manifest:
+    1. Write fn.snapshot.json listing the renames from fn.tmp.* to fn.* (and stale fn.json*
+       files to remove), fsync it and the directory.
+    2. Do the renames, fsync the directory, and remove fn.snapshot.json.
+  If we crash before fn.snapshot.json exists, the old pair is untouched. If we crash after, the
+  next recoverJsonSnapshot (called by readJsonSnapshot and by the next write) finishes the
+  renames.
+  Either way a reader never sees a json file from one snapshot and blobs from another, as long
+  as it reads through readJsonSnapshot.
+
+  Usage:
+    JsonSnapshotWriter snap("state/checkpoint");
+    auto done = snap.write(state); // copies state
+    ...
+    done.get(); // rethrows any error from the write
+
+  write takes the value by value, because the caller can change its copy while the write is
+  in progress. Pass a shared_ptr< Foo const > to avoid copying immutable state.
+  Each writer has one worker thread, which does its writes one at a time in the order write
+  was called, so the last snapshot committed is always the last one written. Dropping the
+  returned future doesn't wait or cancel anything. The destructor finishes any queued writes.
+  Don't have two writers for the same fn.
+*/
+
+struct ChunkFileCompressed;
+
+struct JsonSnapshotWriter {
+  explicit JsonSnapshotWriter(string const &_fn, JsonFileCompression _compression = JSON_FILE_GZIP, size_t _nThreads = 0);
+  ~JsonSnapshotWriter();
+  JsonSnapshotWriter(JsonSnapshotWriter const &) = delete;
+  JsonSnapshotWriter(JsonSnapshotWriter &&) = delete;
+  JsonSnapshotWriter & operator=(JsonSnapshotWriter const &) = delete;
+  JsonSnapshotWriter & operator=(JsonSnapshotWriter &&) = delete;
+
+  template<typename T>
+  future< void > write(T value)
+  {
+    packaged_task< void() > job([this, value = std::move(value)]() {
+      jsonstr js;
+      auto blobs = beginWrite(js);
+      toJson(js, value);
+      finishWrite(js, blobs);
+    });
+    auto ret = job.get_future();
+    enqueue(std::move(job));
+    return ret;
+  }
+
+  void enqueue(packaged_task< void() > &&job);
+  void work();
+  shared_ptr< ChunkFileCompressed > beginWrite(jsonstr &js);
+  void finishWrite(jsonstr &js, shared_ptr< ChunkFileCompressed > &blobs);
+
+  string fn;
+  JsonFileCompression compression;
+  size_t nThreads;
+
+  mutex jobsMutex;
+  condition_variable jobsCv;
+  deque< packaged_task< void() > > jobs;
+  bool stopping { false };
+  thread worker; // Started by the first write
+};
+
+/*
+  Finish a commit interrupted by a crash, if any. Returns false if there was nothing to do.
+  Throws runtime_error if the file system fails.
+*/
+bool recoverJsonSnapshot(string const &fn);
+
+/*
+  recoverJsonSnapshot, then jsonstr::readFromFile
+*/
+int readJsonSnapshot(string const &fn, jsonstr &js, size_t nThreads = 0);
@@ -1,5 +1,6 @@
 #include "tlbcore/common/std_headers.h"
 #include "./jsonio.h"
+#include "./ndarray_encoding.h"
 #include "build.src/arma_types_decl.h"
 /*
   As used by Python's numpy, which we interoperate with.
@@ -660,6 +661,140 @@ void accum_range(MinMax &it, bool value, bool &first)
 }
 
 
+/*
+  Store n elements in a blob, filling in nd.partOfs, nd.partBytes and nd.dtype. nd.range must
+  already be set, since float types may be encoded (see ndarray_encoding.h) according to the
+  ChunkFile's floatPrecision and deltaEncode settings. Everything else is stored natively.
+*/
+template<typename T>
+static void wrBlobElems(WrJsonContext &ctx, T const *p, size_t n, ndarray &nd)
+{
+  nd.partBytes = mul_overflow< size_t >(n, sizeof(T));
+  nd.partOfs = ctx.blobs->writeChunk(reinterpret_cast<char const *>(p), nd.partBytes);
+  nd.dtype = ndarray_dtype(T());
+}
+
+template<typename T>
+static void wrBlobFloatElems(WrJsonContext &ctx, T const *p, size_t n, ndarray &nd)
+{
+  vector< char > enc;
+  string dtype = ndarrayEncode(ctx.blobs->floatPrecision, ctx.blobs->deltaEncode, p, n, nd.range.min, nd.range.max, enc);
+  if (dtype.empty()) {
+    wrBlobElems< T >(ctx, p, n, nd);
+    return;
+  }
+  nd.partBytes = enc.size();
+  nd.partOfs = ctx.blobs->writeChunk(enc.data(), enc.size());
+  nd.dtype = dtype;
+}
+
+static void wrBlobElems(WrJsonContext &ctx, double const *p, size_t n, ndarray &nd)
+{
+  wrBlobFloatElems(ctx, p, n, nd);
+}
+
+static void wrBlobElems(WrJsonContext &ctx, float const *p, size_t n, ndarray &nd)
+{
+  wrBlobFloatElems(ctx, p, n, nd);
+}
+
+/*
+  The dtype wrBlobElems will write, for sizing
+*/
+template<typename T>
+static string wrBlobDtype(WrJsonContext & /* ctx */, T const &x)
+{
+  return ndarray_dtype(x);
+}
+
+static string wrBlobDtype(WrJsonContext &ctx, double const &x)
+{
+  return ndarrayEncodedDtype(ctx.blobs->floatPrecision, ctx.blobs->deltaEncode, ndarray_dtype(x));
+}
+
+static string wrBlobDtype(WrJsonContext &ctx, float const &x)
+{
+  return ndarrayEncodedDtype(ctx.blobs->floatPrecision, ctx.blobs->deltaEncode, ndarray_dtype(x));
+}
+
+/*
+  Read n elements from the blob described by nd. Float types decode any encoding, including
+  the other float type, so a vector< float > can read a blob written from a vector< double >.
+*/
+template<typename T>
+static bool rdBlobElems(RdJsonContext &ctx, ndarray const &nd, T *p, size_t n)
+{
+  if (nd.dtype != ndarray_dtype(T()) || mul_overflow< size_t >(n, sizeof(T)) != nd.partBytes) {
+    return ctx.fail(typeid(T), "Wrong dtype or size");
+  }
+  if (!ctx.blobs->readChunk(reinterpret_cast<char *>(p), nd.partOfs, nd.partBytes)) {
+    return ctx.fail(typeid(T), stringprintf("No chunk %zu %zu", (size_t)nd.partOfs, (size_t)nd.partBytes));
+  }
+  return true;
+}
+
+template<typename T>
+static bool rdBlobFloatElems(RdJsonContext &ctx, ndarray const &nd, T *p, size_t n)
+{
+  if (nd.dtype == ndarray_dtype(T())) return rdBlobElems< T >(ctx, nd, p, n);
+  vector< char > enc(nd.partBytes);
+  if (!ctx.blobs->readChunk(enc.data(), nd.partOfs, nd.partBytes)) {
+    return ctx.fail(typeid(T), stringprintf("No chunk %zu %zu", (size_t)nd.partOfs, (size_t)nd.partBytes));
+  }
+  if (!ndarrayDecode(nd.dtype, enc.data(), enc.size(), nd.range.min, nd.range.max, p, n)) {
+    return ctx.fail(typeid(T), "Wrong dtype or size");
+  }
+  return true;
+}
+
+static bool rdBlobElems(RdJsonContext &ctx, ndarray const &nd, double *p, size_t n)
+{
+  return rdBlobFloatElems(ctx, nd, p, n);
+}
+
+static bool rdBlobElems(RdJsonContext &ctx, ndarray const &nd, float *p, size_t n)
+{
+  return rdBlobFloatElems(ctx, nd, p, n);
+}
+
+
+/*
+  Read a JSON array into p[0], p[stride], p[2*stride] ... without any temporary storage.
+  Up to n elements are stored and any more are parsed and dropped. nRead gets the total.
+*/
+template<typename T>
+static bool rdJsonElems(RdJsonContext &ctx, T *p, size_t n, size_t stride, size_t &nRead, std::type_info const &t)
+{
+  ctx.skipSpace();
+  if (*ctx.s != '[') return ctx.fail(t, "Expected [");
+  ctx.s++;
+  nRead = 0;
+  while (1) {
+    ctx.skipSpace();
+    if (*ctx.s == ']') break;
+    if (nRead < n) {
+      if (!rdJson(ctx, p[nRead * stride])) return ctx.fail(t, "rdJson(elem)");
+    } else {
+      T tmp;
+      if (!rdJson(ctx, tmp)) return ctx.fail(t, "rdJson(elem)");
+    }
+    nRead++;
+    ctx.skipSpace();
+    if (*ctx.s == ',') {
+      ctx.s++;
+    }
+    else if (*ctx.s == ']') {
+      break;
+    }
+    else {
+      return ctx.fail(t, "Expected , or ]");
+    }
+  }
+  ctx.s++;
+  return true;
+}
+
+
 /*
   Json - arma::Col< T >
 */
@@ -667,7 +802,7 @@ template<typename T>
 void wrJsonSize(WrJsonContext &ctx, arma::Col< T > const &arr) {
   if (ctx.blobs) {
     // fake numbers other than 0 or 1 (which are optimized) to allocate size for any number
-    ndarray nd(9, 9, ndarray_dtype(arr[0]), vector< U64 >({arr.n_elem}), MinMax(9.0, 9.0));
+    ndarray nd(9, 9, wrBlobDtype(ctx, T()), vector< U64 >({arr.n_elem}), MinMax(9.0, 9.0));
     wrJsonSize(ctx, nd);
   } else {
     ctx.size += 2 + arr.n_elem; // brackets, commas
@@ -680,9 +815,10 @@ void wrJsonSize(WrJsonContext &ctx, arma::Col< T > const &arr) {
 template<typename T>
 void wrJson(WrJsonContext &ctx, arma::Col< T > const &arr) {
   if (ctx.blobs) {
-    size_t partBytes = mul_overflow< size_t >((size_t)arr.n_elem, sizeof(arr[0]));
-    off_t partOfs = ctx.blobs->writeChunk(reinterpret_cast<char const *>(arr.memptr()), partBytes);
-    ndarray nd(partOfs, partBytes, ndarray_dtype(arr[0]), vector< U64 >({arr.n_elem}), arma_MinMax(arr));
+    ndarray nd;
+    nd.shape.push_back(arr.n_elem);
+    if (arr.n_elem) nd.range = arma_MinMax(arr);
+    wrBlobElems(ctx, arr.memptr(), arr.n_elem, nd);
     wrJson(ctx, nd);
   } else {
     *ctx.s++ = '[';
@@ -700,50 +836,25 @@ template<typename T>
 bool rdJson(RdJsonContext &ctx, arma::Col< T > &arr) {
   ctx.skipSpace();
   if (*ctx.s == '[') {
-    ctx.s++;
-    vector< T > tmparr;
-    while (1) {
-      ctx.skipSpace();
-      if (*ctx.s == ']') break;
-      T tmp;
-      if (!rdJson(ctx, tmp)) return ctx.fail(typeid(arr), "rdJson(tmp)");
-      tmparr.push_back(tmp);
-      ctx.skipSpace();
-      if (*ctx.s == ',') {
-        ctx.s++;
-      }
-      else if (*ctx.s == ']') {
-        break;
-      }
-      else {
-        return ctx.fail(typeid(arr), "Expected , or ]");
-      }
-    }
-    ctx.s++;
+    size_t n_data = ctx.countArrayElems();
     // set_size will throw a logic_error if we're reading to a fixed_sized arma::Col and the size is wrong
     // If I could figure out how to tell whether the type is fixed or not, I could check for it and return
     // false instead.
-    if (!(tmparr.size() < (size_t)numeric_limits< int >::max())) throw length_error("rdJson< arma::Col >");
-    arr.set_size(tmparr.size());
-    for (size_t i=0; i < tmparr.size(); i++) {
-      arr(i) = tmparr[i];
-    }
+    if (!(n_data < (size_t)numeric_limits< int >::max())) throw length_error("rdJson< arma::Col >");
+    arr.set_size(n_data);
+    size_t n_read = 0;
+    if (!rdJsonElems(ctx, arr.memptr(), n_data, 1, n_read, typeid(arr))) return false;
+    if (n_read != n_data) return ctx.fail(typeid(arr), "Element count mismatch");
     return true;
   }
   else if (*ctx.s == '{' && ctx.blobs) {
     ndarray nd;
     if (!rdJson(ctx, nd)) return ctx.fail(typeid(arr), "rdJson(nd)");
+    if (nd.shape.size() != 1) return ctx.fail(typeid(arr), "Wrong shape");
+    if (nd.shape[0] > (U64)numeric_limits< int >::max() / sizeof(T)) throw length_error("rdJson< arma::Col >");
     arr.set_size(nd.shape[0]);
-    if ((size_t)arr.n_elem > (size_t)numeric_limits< int >::max() / sizeof(arr[0])) throw length_error("rdJson< arma::Col >");
-    size_t partBytes = mul_overflow< size_t >((size_t)arr.n_elem, sizeof(arr[0]));
-    string arr_dtype = ndarray_dtype(arr[0]);
-    if (arr_dtype == nd.dtype && partBytes == nd.partBytes) {
-      ctx.blobs->readChunk(reinterpret_cast<char *>(arr.memptr()), nd.partOfs, partBytes);
-      return true;
-    }
-    else {
-      return ctx.fail(typeid(arr), "Wrong dtype or size");
-    }
+    if (!rdBlobElems(ctx, nd, arr.memptr(), arr.n_elem)) return ctx.fail(typeid(arr), "rdBlobElems");
+    return true;
   }
   else {
     return ctx.fail(typeid(arr), "Expected [ or {");
@@ -781,31 +892,12 @@ bool rdJson(RdJsonContext &ctx, arma::Row< T > &arr) {
   ctx.skipSpace();
   // FIXME: blobs
   if (*ctx.s != '[') return ctx.fail(typeid(arr), "Expected [");
-  ctx.s++;
-  vector< T > tmparr;
-  while (1) {
-    ctx.skipSpace();
-    if (*ctx.s == ']') break;
-    T tmp;
-    if (!rdJson(ctx, tmp)) return ctx.fail(typeid(arr), "rdJson(tmp)");
-    tmparr.push_back(tmp);
-    ctx.skipSpace();
-    if (*ctx.s == ',') {
-      ctx.s++;
-    }
-    else if (*ctx.s == ']') {
-      break;
-    }
-    else {
-      return ctx.fail(typeid(arr), "Expected , or ]");
-    }
-  }
-  ctx.s++;
-  if (!(tmparr.size() < (size_t)numeric_limits< int >::max())) throw overflow_error("rdJson< arma::Row >");
-  arr.set_size(tmparr.size());
-  for (size_t i=0; i < tmparr.size(); i++) {
-    arr(i) = tmparr[i];
-  }
+  size_t n_data = ctx.countArrayElems();
+  if (!(n_data < (size_t)numeric_limits< int >::max())) throw overflow_error("rdJson< arma::Row >");
+  arr.set_size(n_data);
+  size_t n_read = 0;
+  if (!rdJsonElems(ctx, arr.memptr(), n_data, 1, n_read, typeid(arr))) return false;
+  if (n_read != n_data) return ctx.fail(typeid(arr), "Element count mismatch");
   return true;
 }
 
@@ -838,29 +930,39 @@ bool rdJson(RdJsonContext &ctx, arma::Mat< T > &arr) {
   ctx.skipSpace();
   // FIXME: blobs
   if (*ctx.s != '[') return ctx.fail(typeid(arr), "Expected [");
-  ctx.s++;
-  vector< T > tmparr;
-  while (1) {
-    ctx.skipSpace();
-    if (*ctx.s == ']') break;
-    T tmp;
-    if (!rdJson(ctx, tmp)) return ctx.fail(typeid(arr), "rdJson(tmp)");
-    tmparr.push_back(tmp);
-    ctx.skipSpace();
-    if (*ctx.s == ',') {
-      ctx.s++;
-    }
-    else if (*ctx.s == ']') {
-      break;
-    }
-    else {
-      return ctx.fail(typeid(arr), "Expected , or ]");
+
+  char const *p = ctx.s + 1;
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+  if (*p == '[') {
+    /*
+      Nested [[row0...],[row1...]...], as from numpy or JS. Each row is read with a stride of
+      n_rows, straight into column-major storage.
+    */
+    size_t n_rows = ctx.countArrayElems();
+    ctx.s = p;
+    size_t n_cols = ctx.countArrayElems();
+    if (!(n_rows * n_cols < (size_t)numeric_limits< int >::max())) throw overflow_error("rdJson< arma::Mat >");
+    arr.set_size(n_rows, n_cols);
+    for (size_t ri = 0; ri < n_rows; ri++) {
+      size_t n_read = 0;
+      if (!rdJsonElems(ctx, arr.memptr() + ri, n_cols, n_rows, n_read, typeid(arr))) return false;
+      if (n_read != n_cols) return ctx.fail(typeid(arr), "Ragged rows");
+      ctx.skipSpace();
+      if (*ctx.s == ',') {
+        ctx.s++;
+      }
+      else if (*ctx.s != ']') {
+        return ctx.fail(typeid(arr), "Expected , or ]");
+      }
     }
+    ctx.skipSpace();
+    if (*ctx.s != ']') return ctx.fail(typeid(arr), "Expected ]");
+    ctx.s++;
+    return true;
   }
-  ctx.s++;
 
   size_t n_rows = arr.n_rows, n_cols = arr.n_cols;
-  size_t n_data = tmparr.size();
+  size_t n_data = ctx.countArrayElems();
   if (n_rows == 0 && n_cols == 0) {
     switch (n_data) {
     case 0: n_rows = 0; n_cols = 0; break;
@@ -893,9 +995,9 @@ bool rdJson(RdJsonContext &ctx, arma::Mat< T > &arr) {
   }
   if (0) eprintf("rdJson(arma::Mat): %dx%d -> %dx%d (from %d)\n", (int)arr.n_rows, (int)arr.n_cols, (int)n_rows, (int)n_cols, (int)n_data);
   arr.set_size(n_rows, n_cols);
-  for (size_t ei=0; ei < arr.n_elem && ei < n_data; ei++) {
-    arr(ei) = tmparr[ei];
-  }
+  size_t n_read = 0;
+  if (!rdJsonElems(ctx, arr.memptr(), arr.n_elem, 1, n_read, typeid(arr))) return false;
+  if (n_read != n_data) return ctx.fail(typeid(arr), "Element count mismatch");
   return true;
 }
 
@@ -907,21 +1009,19 @@ template<typename T>
 void wrJsonBin(WrJsonContext &ctx, vector< T > const &arr)
 {
   ndarray nd;
-  nd.partBytes = mul_overflow< size_t >(arr.size(), sizeof(T));
-  nd.partOfs = ctx.blobs->writeChunk(reinterpret_cast<char const *>(&arr[0]), nd.partBytes);
-  nd.dtype = ndarray_dtype(T());
   nd.shape.push_back(arr.size());
   bool first = true;
   for (auto it : arr) {
     accum_range(nd.range, it, first);
   }
+  wrBlobElems(ctx, arr.data(), arr.size(), nd);
   wrJson(ctx, nd);
 }
 
 template<typename T>
 void wrJsonSizeBin(WrJsonContext &ctx, vector< T > const &arr)
 {
-  ndarray nd(9, 9, ndarray_dtype(T()), vector< U64 >({(U64)arr.size()}), MinMax(9.0, 9.0));
+  ndarray nd(9, 9, wrBlobDtype(ctx, T()), vector< U64 >({(U64)arr.size()}), MinMax(9.0, 9.0));
   wrJsonSize(ctx, nd);
 }
 
@@ -930,9 +1030,10 @@ bool rdJsonBin(RdJsonContext &ctx, vector< T > &arr)
 {
   ndarray nd;
   if (rdJson(ctx, nd)) {
-    if (nd.dtype == ndarray_dtype(T()) && nd.shape.size() == 1 && mul_overflow< size_t >(nd.shape[0], sizeof(T)) == nd.partBytes) {
+    // Every encoding takes at least a byte per element, so this bounds the allocation
+    if (nd.shape.size() == 1 && nd.shape[0] <= nd.partBytes) {
       arr.resize(nd.shape[0]);
-      if (ctx.blobs->readChunk(reinterpret_cast<char *>(arr.data()), nd.partOfs, nd.partBytes)) {
+      if (rdBlobElems(ctx, nd, arr.data(), arr.size())) {
         return true;
       }
     }
@@ -1156,9 +1257,7 @@ void wrJsonBin(WrJsonContext &ctx, vector< typename arma::Col< T > > const &arr)
       accum_range(nd.range, slice[i * n + k], first);
     }
   }
-  nd.partBytes = mul_overflow< size_t >(slice.size(), sizeof(T));
-  nd.partOfs = ctx.blobs->writeChunk(reinterpret_cast<char const *>(slice.data()), nd.partBytes);
-  nd.dtype = ndarray_dtype(T());
+  wrBlobElems(ctx, slice.data(), slice.size(), nd);
   nd.shape.push_back(arr.size());
   nd.shape.push_back(n);
   wrJson(ctx, nd);
@@ -1167,7 +1266,7 @@ void wrJsonBin(WrJsonContext &ctx, vector< typename arma::Col< T > > const &arr)
 template<typename T>
 void wrJsonSizeBin(WrJsonContext &ctx, vector< typename arma::Col< T > > const &arr)
 {
-  ndarray nd(9, 9, ndarray_dtype(T()), vector< U64 >({9, 9}), MinMax(9.0, 9.0));
+  ndarray nd(9, 9, wrBlobDtype(ctx, T()), vector< U64 >({9, 9}), MinMax(9.0, 9.0));
   wrJsonSize(ctx, nd);
 }
 
@@ -1188,15 +1287,10 @@ bool rdJsonBin(RdJsonContext &ctx, vector< typename arma::Col< T > > &arr)
   size_t n = nd.shape[1];
 
   vector< T > tmp(nd.shape[0] * nd.shape[1]);
-  if (tmp.size() * sizeof(T) != nd.partBytes) {
+  if (!rdBlobElems(ctx, nd, tmp.data(), tmp.size())) {
     return ctx.fail(typeid(arr), stringprintf(
-      "rdJson(arma::Col< T >: size mismatch: %zu*%zu != %zu\\n",
-      tmp.size(), sizeof(T), (size_t)nd.partBytes));
-  }
-  if (!ctx.blobs->readChunk(reinterpret_cast<char *>(tmp.data()), nd.partOfs, nd.partBytes)) {
-    return ctx.fail(typeid(arr), stringprintf(
-      "rdJson(arma::Col< T >): no chunk %zu %zu\\n",
-      (size_t)nd.partOfs, (size_t)nd.partBytes));
+      "rdJson(arma::Col< T >): can't read %zu elements from %s blob of %zu bytes",
+      tmp.size(), nd.dtype.c_str(), (size_t)nd.partBytes));
   }
 
   for (size_t i=0; i<arr.size(); i++) {
@@ -1225,9 +1319,7 @@ void wrJsonBin(WrJsonContext &ctx, vector< typename arma::Row< T > > const &arr)
       accum_range(nd.range, slice[i * n + k], first);
     }
   }
-  nd.partBytes = mul_overflow< size_t >(slice.size(), sizeof(T));
-  nd.partOfs = ctx.blobs->writeChunk(reinterpret_cast<char const *>(slice.data()), nd.partBytes);
-  nd.dtype = ndarray_dtype(T());
+  wrBlobElems(ctx, slice.data(), slice.size(), nd);
   nd.shape.push_back(arr.size());
   nd.shape.push_back(n);
   wrJson(ctx, nd);
@@ -1236,7 +1328,7 @@ void wrJsonBin(WrJsonContext &ctx, vector< typename arma::Row< T > > const &arr)
 template<typename T>
 void wrJsonSizeBin(WrJsonContext &ctx, vector< typename arma::Row< T > > const &arr)
 {
-  ndarray nd(9, 9, ndarray_dtype(T()), vector< U64 >({9, 9}), MinMax(9.0, 9.0));
+  ndarray nd(9, 9, wrBlobDtype(ctx, T()), vector< U64 >({9, 9}), MinMax(9.0, 9.0));
   wrJsonSize(ctx, nd);
 }
 
@@ -1257,14 +1349,10 @@ bool rdJsonBin(RdJsonContext &ctx, vector< typename arma::Row< T > > &arr)
   size_t n = nd.shape[1];
 
   vector< T > tmp(nd.shape[0] * nd.shape[1]);
-  if (tmp.size() * sizeof(T) != nd.partBytes) {
+  if (!rdBlobElems(ctx, nd, tmp.data(), tmp.size())) {
     return ctx.fail(typeid(arr), stringprintf(
-      "rdJson(arma::Row< T >: size mismatch: %zu*%zu != %zu\\n",
-      tmp.size(), sizeof(T), (size_t)nd.partBytes));
-  }
-  if (!ctx.blobs->readChunk(reinterpret_cast<char *>(tmp.data()), nd.partOfs, nd.partBytes)) {
-    return ctx.fail(typeid(arr), stringprintf("rdJson(arma::Row< T >): no chunk %zu %zu\\n",
-      (size_t)nd.partOfs, (size_t)nd.partBytes));
+      "rdJson(arma::Row< T >): can't read %zu elements from %s blob of %zu bytes",
+      tmp.size(), nd.dtype.c_str(), (size_t)nd.partBytes));
   }
 
   for (size_t i=0; i<arr.size(); i++) {
@@ -1296,9 +1384,7 @@ void wrJsonBin(WrJsonContext &ctx, vector< typename arma::Mat< T > > const &arr)
       accum_range(nd.range, slice[i * ne + k], first);
     }
   }
-  nd.partBytes = mul_overflow< size_t >(slice.size(), sizeof(T));
-  nd.partOfs = ctx.blobs->writeChunk(reinterpret_cast<char const *>(slice.data()), nd.partBytes);
-  nd.dtype = ndarray_dtype(T());
+  wrBlobElems(ctx, slice.data(), slice.size(), nd);
   nd.shape.push_back(arr.size());
   nd.shape.push_back(nc);
   nd.shape.push_back(nr);
@@ -1308,7 +1394,7 @@ void wrJsonBin(WrJsonContext &ctx, vector< typename arma::Mat< T > > const &arr)
 template<typename T>
 void wrJsonSizeBin(WrJsonContext &ctx, vector< typename arma::Mat< T > > const &arr)
 {
-  ndarray nd(9, 9, ndarray_dtype(T()), vector< U64 >({9, 9, 9}), MinMax(9.0, 9.0));
+  ndarray nd(9, 9, wrBlobDtype(ctx, T()), vector< U64 >({9, 9, 9}), MinMax(9.0, 9.0));
   wrJsonSize(ctx, nd);
 }
 
@@ -1332,15 +1418,10 @@ bool rdJsonBin(RdJsonContext &ctx, vector< typename arma::Mat< T > > &arr)
   size_t ne = nr*nc;
 
   vector< T > tmp(nd.shape[0] * ne);
-  if (tmp.size() * sizeof(T) != nd.partBytes) {
-    return ctx.fail(typeid(arr), stringprintf(
-      "rdJson(arma::Mat< T >: size mismatch: %zu*%zu != %zu\\n",
-      tmp.size(), sizeof(T), (size_t)nd.partBytes));
-  }
-  if (!ctx.blobs->readChunk(reinterpret_cast<char *>(tmp.data()), nd.partOfs, nd.partBytes)) {
+  if (!rdBlobElems(ctx, nd, tmp.data(), tmp.size())) {
     return ctx.fail(typeid(arr), stringprintf(
-      "rdJson(arma::Mat< T >): no chunk %zu %zu\\n",
-      (size_t)nd.partOfs, (size_t)nd.partBytes));
+      "rdJson(arma::Mat< T >): can't read %zu elements from %s blob of %zu bytes",
+      tmp.size(), nd.dtype.c_str(), (size_t)nd.partBytes));
   }
 
   for (size_t i=0; i<arr.size(); i++) {
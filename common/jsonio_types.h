@@ -427,7 +427,7 @@ bool rdJsonVec(RdJsonContext &ctx, vector< shared_ptr< T > > &arr) {
 */
 template<typename KT, typename VT>
 void wrJsonSize(WrJsonContext &ctx, map< KT, VT > const &arr) {
-  ctx.size += 2;
+  ctx.size += 2 + ctx.skipHintSize();
   for (auto it = arr.begin(); it != arr.end(); it++) {
     wrJsonSize(ctx, it->first);
     wrJsonSize(ctx, it->second);
@@ -437,6 +437,7 @@ void wrJsonSize(WrJsonContext &ctx, map< KT, VT > const &arr) {
 template<typename KT, typename VT>
 void wrJson(WrJsonContext &ctx, map< KT, VT > const &arr) {
   *ctx.s++ = '{';
+  char *hint = ctx.beginSkipHint();
   bool sep = false;
   for (auto it = arr.begin(); it != arr.end(); it++) {
     if (sep) *ctx.s++ = ',';
@@ -446,12 +447,14 @@ void wrJson(WrJsonContext &ctx, map< KT, VT > const &arr) {
     wrJson(ctx, it->second);
   }
   *ctx.s++ = '}';
+  ctx.endSkipHint(hint);
 }
 template<typename KT, typename VT>
 bool rdJson(RdJsonContext &ctx, map< KT, VT > &arr) {
   ctx.skipSpace();
   if (*ctx.s != '{') return ctx.fail(typeid(arr), "expected {");
   ctx.s++;
+  ctx.skipHint();
   arr.clear();
   while (1) {
     ctx.skipSpace();
@@ -487,7 +490,7 @@ bool rdJson(RdJsonContext &ctx, map< KT, VT > &arr) {
 */
 template<typename KT, typename VT>
 void wrJsonSize(WrJsonContext &ctx, map< KT, shared_ptr< VT > > const &arr) {
-  ctx.size += 2;
+  ctx.size += 2 + ctx.skipHintSize();
   for (auto it = arr.begin(); it != arr.end(); it++) {
     if (!it->second) continue;
     wrJsonSize(ctx, it->first);
@@ -498,6 +501,7 @@ void wrJsonSize(WrJsonContext &ctx, map< KT, shared_ptr< VT > > const &arr) {
 template<typename KT, typename VT>
 void wrJson(WrJsonContext &ctx, map< KT, shared_ptr< VT > > const &arr) {
   *ctx.s++ = '{';
+  char *hint = ctx.beginSkipHint();
   bool sep = false;
   for (auto it = arr.begin(); it != arr.end(); it++) {
     if (!it->second) continue;
@@ -508,12 +512,14 @@ void wrJson(WrJsonContext &ctx, map< KT, shared_ptr< VT > > const &arr) {
     wrJson(ctx, *it->second);
   }
   *ctx.s++ = '}';
+  ctx.endSkipHint(hint);
 }
 template<typename KT, typename VT>
 bool rdJson(RdJsonContext &ctx, map< KT, shared_ptr< VT > > &arr) {
   ctx.skipSpace();
   if (*ctx.s != '{') return ctx.fail(typeid(arr), "Expected {");
   ctx.s++;
+  ctx.skipHint();
   arr.clear();
   while (1) {
     ctx.skipSpace();
@@ -0,0 +1,126 @@
+#include "tlbcore/common/std_headers.h"
+#include "./line_reader.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+LineReader::LineReader(int _fd, char _delim)
+  :fd(_fd),
+   delim(_delim)
+{
+  setup();
+}
+
+LineReader::LineReader(string const &_fn, char _delim)
+  :fn(_fn),
+   delim(_delim)
+{
+  fd = open(fn.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    throw runtime_error(string("Open ") + fn + string(": ") + string(strerror(errno)));
+  }
+  ownFd = true;
+  setup();
+}
+
+LineReader::~LineReader()
+{
+  if (mapBase) {
+    munmap(const_cast<char *>(mapBase), mapSize);
+    mapBase = nullptr;
+  }
+  if (ownFd && fd != -1) {
+    close(fd);
+  }
+  fd = -1;
+}
+
+/*
+  Map regular files whole, starting from the current file offset. Anything else (or a failed
+  mmap) falls back to reading windows.
+*/
+void LineReader::setup()
+{
+  struct stat st {};
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    off_t startOff = lseek(fd, 0, SEEK_CUR);
+    void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+      mapBase = static_cast<char const *>(p);
+      mapSize = (size_t)st.st_size;
+      bufPos = startOff > 0 ? min((size_t)startOff, mapSize) : 0;
+      bufEnd = mapSize;
+      eof = true;
+      return;
+    }
+  }
+  buf.resize(windowSize);
+}
+
+/*
+  Read more data into the window. Called when buf[scanPos .. bufEnd) has been scanned with no
+  delimiter found. Slides the unread part down to the start of the buffer, growing it if a
+  single record fills the whole thing. Returns false at EOF or on error.
+*/
+bool LineReader::fill(size_t &scanPos)
+{
+  if (bufPos > 0) {
+    memmove(buf.data(), buf.data() + bufPos, bufEnd - bufPos);
+    bufEnd -= bufPos;
+    bufPos = 0;
+  }
+  if (bufEnd == buf.size()) {
+    buf.resize(buf.size() * 2);
+  }
+  scanPos = bufEnd;
+  while (true) {
+    ssize_t nr = read(fd, buf.data() + bufEnd, buf.size() - bufEnd);
+    if (nr < 0) {
+      if (errno == EINTR) continue;
+      eprintf("LineReader %s: %s\n", fn.c_str(), strerror(errno));
+      errFlag = true;
+      eof = true;
+      return false;
+    }
+    if (nr == 0) {
+      eof = true;
+      return false;
+    }
+    bufEnd += (size_t)nr;
+    return true;
+  }
+}
+
+bool LineReader::getLine(char const *&begin, char const *&end)
+{
+  size_t scanPos = bufPos;
+  while (true) {
+    char const *base = mapBase ? mapBase : buf.data();
+    auto found = static_cast<char const *>(memchr(base + scanPos, delim, bufEnd - scanPos));
+    if (found) {
+      begin = base + bufPos;
+      end = found;
+      bufPos = (size_t)(found - base) + 1;
+      break;
+    }
+    if (eof || !fill(scanPos)) {
+      if (bufPos == bufEnd) return false;
+      base = mapBase ? mapBase : buf.data();
+      begin = base + bufPos;
+      end = base + bufEnd;
+      bufPos = bufEnd;
+      break;
+    }
+  }
+  if (delim == '\n' && end > begin && end[-1] == '\r') end--;
+  return true;
+}
+
+bool LineReader::getLine(string &line)
+{
+  char const *begin = nullptr, *end = nullptr;
+  if (!getLine(begin, end)) return false;
+  line.assign(begin, end);
+  return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+  Fast line (or record) reader, for chewing through big config and log files.
+
+  Regular files are mmapped whole, so getLine returns pointers straight into the mapping.
+  Pipes, sockets and ttys are read in large windows (1 MB by default) into a buffer.
+  Either way, records are found with memchr (which libc vectorizes), not a getc per character.
+
+  The [begin, end) pointers returned by getLine point into the reader's buffer, and stay valid
+  until the next call to getLine. They don't include the delimiter, and when the delimiter is
+  '\n' a trailing '\r' is also dropped, like getln does. The last record needn't be terminated.
+
+  Example: {
+    LineReader rd("foo.log");
+    char const *begin, *end;
+    while (rd.getLine(begin, end)) {
+      ...
+    }
+  }
+*/
+
+struct LineReader {
+  explicit LineReader(int _fd, char _delim='\n');
+  explicit LineReader(string const &_fn, char _delim='\n');
+  ~LineReader();
+  LineReader(LineReader const &) = delete;
+  LineReader(LineReader &&) = delete;
+  LineReader & operator = (LineReader const &) = delete;
+  LineReader & operator = (LineReader &&) = delete;
+
+  bool getLine(char const *&begin, char const *&end);
+  bool getLine(string &line);
+
+  void setup();
+  bool fill(size_t &scanPos);
+
+  string fn;
+  int fd {-1};
+  bool ownFd {false};
+  char delim {'\n'};
+  bool errFlag {false};
+
+  // When the whole file is mapped
+  char const *mapBase {nullptr};
+  size_t mapSize {0};
+
+  // Otherwise, a window of the input. Unread data is in buf[bufPos .. bufEnd)
+  vector< char > buf;
+  size_t bufPos {0};
+  size_t bufEnd {0};
+  size_t windowSize {1024*1024};
+  bool eof {false};
+};
@@ -0,0 +1,287 @@
+#include "tlbcore/common/std_headers.h"
+#include "./ndarray_encoding.h"
+
+/*
+  IEEE half precision, rounding to nearest even. Out of range values become Inf.
+*/
+U16 floatToHalf(float f)
+{
+  U32 x;
+  memcpy(&x, &f, sizeof(x));
+  U32 sign = (x >> 16) & 0x8000;
+  U32 absx = x & 0x7fffffff;
+  if (absx >= 0x7f800000) { // Inf or NaN
+    return (U16)(sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0));
+  }
+  if (absx >= 0x477ff000) { // >= 65520 rounds to Inf
+    return (U16)(sign | 0x7c00);
+  }
+  if (absx < 0x38800000) { // Below 2^-14, so subnormal or zero
+    if (absx < 0x33000000) return (U16)sign;
+    U32 shift = 126 - (absx >> 23);
+    U32 m = (absx & 0x7fffff) | 0x800000;
+    U32 r = m >> shift;
+    U32 rem = m & ((1u << shift) - 1);
+    U32 half = 1u << (shift - 1);
+    if (rem > half || (rem == half && (r & 1))) r++;
+    return (U16)(sign | r);
+  }
+  U32 r = absx - 0x38000000; // Rebias the exponent from 127 to 15
+  U32 h = r >> 13;
+  U32 rem = r & 0x1fff;
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++; // A carry into the exponent is still right
+  return (U16)(sign | h);
+}
+
+float halfToFloat(U16 h)
+{
+  U32 sign = (U32)(h & 0x8000) << 16;
+  U32 e = (h >> 10) & 0x1f;
+  U32 m = h & 0x3ff;
+  U32 x;
+  if (e == 0x1f) {
+    x = sign | 0x7f800000 | (m << 13);
+  }
+  else if (e == 0) {
+    float f = (float)m * (1.0f / 16777216.0f);
+    return sign ? -f : f;
+  }
+  else {
+    x = sign | ((e + 112) << 23) | (m << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+
+/*
+  Storage types, as bits so XOR works on them
+*/
+template<typename STORE>
+static void wrStore(vector< char > &out, size_t n, bool xorPrev, STORE const *bits)
+{
+  out.resize(n * sizeof(STORE));
+  STORE *o = reinterpret_cast< STORE * >(out.data());
+  if (xorPrev) {
+    STORE prev = 0;
+    for (size_t i = 0; i < n; i++) {
+      o[i] = bits[i] ^ prev;
+      prev = bits[i];
+    }
+  } else {
+    memcpy(o, bits, n * sizeof(STORE));
+  }
+}
+
+template<typename T, typename BITS>
+static void floatBits(T const *p, size_t n, vector< BITS > &bits)
+{
+  static_assert(sizeof(T) == sizeof(BITS), "floatBits: size mismatch");
+  bits.resize(n);
+  memcpy(bits.data(), p, n * sizeof(T));
+}
+
+template<typename T>
+static bool allFinite(T const *p, size_t n)
+{
+  int bad = 0;
+  for (size_t i = 0; i < n; i++) {
+    bad |= !(p[i] - p[i] == 0);
+  }
+  return !bad;
+}
+
+/*
+  Quantize to 0..QMAX over [lo, hi], optionally storing differences. p must be finite, so
+  after clamping the +0.5 rounding is safe to truncate.
+*/
+template<typename Q, typename T>
+static void quantize(T const *p, size_t n, double lo, double hi, bool delta, vector< char > &out)
+{
+  double const qmax = (double)numeric_limits< Q >::max();
+  double scale = hi > lo ? qmax / (hi - lo) : 0.0;
+  out.resize(n * sizeof(Q));
+  Q *o = reinterpret_cast< Q * >(out.data());
+  for (size_t i = 0; i < n; i++) {
+    double qf = ((double)p[i] - lo) * scale + 0.5;
+    qf = qf < 0.0 ? 0.0 : (qf > qmax ? qmax : qf);
+    o[i] = (Q)qf;
+  }
+  if (delta) {
+    Q prev = 0;
+    for (size_t i = 0; i < n; i++) {
+      Q cur = o[i];
+      o[i] = (Q)(cur - prev);
+      prev = cur;
+    }
+  }
+}
+
+template<typename Q, typename T>
+static void dequantize(Q const *q, size_t n, double lo, double hi, bool delta, T *p)
+{
+  double step = (hi - lo) / (double)numeric_limits< Q >::max();
+  if (delta) {
+    Q acc = 0;
+    for (size_t i = 0; i < n; i++) {
+      acc = (Q)(acc + q[i]);
+      p[i] = (T)(lo + acc * step);
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      p[i] = (T)(lo + q[i] * step);
+    }
+  }
+}
+
+template<typename T>
+static string ndarrayEncodeT(BlobPrecision precision, bool delta, T const *p, size_t n, double lo, double hi, vector< char > &out, string const &nativeDtype)
+{
+  switch (precision) {
+
+  case BLOB_UINT8:
+  case BLOB_UINT16:
+    if (allFinite(p, n) && isfinite(lo) && isfinite(hi)) {
+      string dtype;
+      if (precision == BLOB_UINT8) {
+        quantize< U8 >(p, n, lo, hi, delta, out);
+        dtype = "uint8/lin";
+      } else {
+        quantize< U16 >(p, n, lo, hi, delta, out);
+        dtype = "uint16/lin";
+      }
+      return delta ? dtype + "/delta" : dtype;
+    }
+    // Fall back to native
+    if (!delta) return "";
+    precision = BLOB_NATIVE;
+    break;
+
+  default:
+    break;
+  }
+
+  if (precision == BLOB_FLOAT16) {
+    vector< U16 > bits(n);
+    for (size_t i = 0; i < n; i++) {
+      bits[i] = floatToHalf((float)p[i]);
+    }
+    wrStore(out, n, delta, bits.data());
+    return delta ? "float16/xor" : "float16";
+  }
+  if (precision == BLOB_FLOAT32 && sizeof(T) > sizeof(float)) {
+    vector< float > narrow(p, p + n);
+    vector< U32 > bits;
+    floatBits(narrow.data(), n, bits);
+    wrStore(out, n, delta, bits.data());
+    return delta ? "float32/xor" : "float32";
+  }
+  if (!delta) return "";
+  if (sizeof(T) == sizeof(U64)) {
+    vector< U64 > bits;
+    floatBits(reinterpret_cast< double const * >(p), n, bits);
+    wrStore(out, n, true, bits.data());
+  } else {
+    vector< U32 > bits;
+    floatBits(reinterpret_cast< float const * >(p), n, bits);
+    wrStore(out, n, true, bits.data());
+  }
+  return nativeDtype + "/xor";
+}
+
+string ndarrayEncode(BlobPrecision precision, bool delta, double const *p, size_t n, double lo, double hi, vector< char > &out)
+{
+  return ndarrayEncodeT(precision, delta, p, n, lo, hi, out, "float64");
+}
+
+string ndarrayEncode(BlobPrecision precision, bool delta, float const *p, size_t n, double lo, double hi, vector< char > &out)
+{
+  return ndarrayEncodeT(precision, delta, p, n, lo, hi, out, "float32");
+}
+
+string ndarrayEncodedDtype(BlobPrecision precision, bool delta, string const &nativeDtype)
+{
+  switch (precision) {
+  case BLOB_UINT8: return delta ? "uint8/lin/delta" : "uint8/lin";
+  case BLOB_UINT16: return delta ? "uint16/lin/delta" : "uint16/lin";
+  case BLOB_FLOAT16: return delta ? "float16/xor" : "float16";
+  case BLOB_FLOAT32: return delta ? "float32/xor" : "float32";
+  default: return delta ? nativeDtype + "/xor" : nativeDtype;
+  }
+}
+
+
+/*
+  Undo XOR with the previous element, then convert from the storage float type
+*/
+template<typename BITS, typename STORE, typename T>
+static void unXorFloats(char const *data, size_t n, bool xorPrev, T *p)
+{
+  BITS const *in = reinterpret_cast< BITS const * >(data);
+  BITS prev = 0;
+  for (size_t i = 0; i < n; i++) {
+    BITS cur = xorPrev ? (BITS)(in[i] ^ prev) : in[i];
+    prev = cur;
+    STORE v;
+    memcpy(&v, &cur, sizeof(v));
+    p[i] = (T)v;
+  }
+}
+
+template<typename T>
+static bool ndarrayDecodeT(string const &dtype, char const *data, size_t nBytes, double lo, double hi, T *p, size_t n)
+{
+  string storage = dtype;
+  bool lin = false, delta = false, xorPrev = false;
+  size_t slash = dtype.find('/');
+  if (slash != string::npos) {
+    storage = dtype.substr(0, slash);
+    string mods = dtype.substr(slash);
+    if (mods == "/lin") lin = true;
+    else if (mods == "/lin/delta") lin = delta = true;
+    else if (mods == "/xor") xorPrev = true;
+    else return false;
+  }
+
+  if (lin) {
+    if (storage == "uint8" && nBytes == n * sizeof(U8)) {
+      dequantize(reinterpret_cast< U8 const * >(data), n, lo, hi, delta, p);
+      return true;
+    }
+    if (storage == "uint16" && nBytes == n * sizeof(U16)) {
+      dequantize(reinterpret_cast< U16 const * >(data), n, lo, hi, delta, p);
+      return true;
+    }
+    return false;
+  }
+  if (storage == "float64" && nBytes == n * sizeof(double)) {
+    unXorFloats< U64, double >(data, n, xorPrev, p);
+    return true;
+  }
+  if (storage == "float32" && nBytes == n * sizeof(float)) {
+    unXorFloats< U32, float >(data, n, xorPrev, p);
+    return true;
+  }
+  if (storage == "float16" && nBytes == n * sizeof(U16)) {
+    U16 const *in = reinterpret_cast< U16 const * >(data);
+    U16 prev = 0;
+    for (size_t i = 0; i < n; i++) {
+      U16 cur = xorPrev ? (U16)(in[i] ^ prev) : in[i];
+      prev = cur;
+      p[i] = (T)halfToFloat(cur);
+    }
+    return true;
+  }
+  return false;
+}
+
+bool ndarrayDecode(string const &dtype, char const *data, size_t nBytes, double lo, double hi, double *p, size_t n)
+{
+  return ndarrayDecodeT(dtype, data, nBytes, lo, hi, p, n);
+}
+
+bool ndarrayDecode(string const &dtype, char const *data, size_t nBytes, double lo, double hi, float *p, size_t n)
+{
+  return ndarrayDecodeT(dtype, data, nBytes, lo, hi, p, n);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "./chunk_file.h"
+
+/*
+  Compact encodings for float arrays stored in blobs, selected by ChunkFile::floatPrecision
+  and ChunkFile::deltaEncode.
+
+  The encoding goes in the ndarray's dtype, as the storage type followed by modifiers:
+    float32, float16           Rounded to a narrower float
+    uint8/lin, uint16/lin      Quantized linearly, with 0 and the max value mapping to range.min and range.max
+    .../xor                    Each float's bits XORed with the previous one's, so the high bits
+                               of slowly varying data become zeros
+    .../delta                  Each quantized value stored as the difference (mod 2^bits) from
+                               the previous one
+  So a slowly varying trace might be stored as "uint16/lin/delta". Plain float64 and float32
+  dtypes are still written for native storage, so old readers can read those.
+
+  ndarrayEncode returns the dtype and fills out with the bytes to store, or returns an empty
+  string when the array should be stored natively (BLOB_NATIVE without delta, or quantizing
+  data that isn't finite).
+  ndarrayDecode accepts any dtype ndarrayEncode produces, plus plain float64 and float32, and
+  converts to the requested type. It returns false if it can't parse the dtype or the size is wrong.
+*/
+
+string ndarrayEncode(BlobPrecision precision, bool delta, double const *p, size_t n, double lo, double hi, vector< char > &out);
+string ndarrayEncode(BlobPrecision precision, bool delta, float const *p, size_t n, double lo, double hi, vector< char > &out);
+
+bool ndarrayDecode(string const &dtype, char const *data, size_t nBytes, double lo, double hi, double *p, size_t n);
+bool ndarrayDecode(string const &dtype, char const *data, size_t nBytes, double lo, double hi, float *p, size_t n);
+
+/*
+  The longest dtype ndarrayEncode might produce for the given settings, for wrJsonSize.
+*/
+string ndarrayEncodedDtype(BlobPrecision precision, bool delta, string const &nativeDtype);
+
+U16 floatToHalf(float f);
+float halfToFloat(U16 h);
@@ -0,0 +1,304 @@
+#include "tlbcore/common/std_headers.h"
+#include "./parent_pipe.h"
+
+ParentJsonPipe::ParentJsonPipe(uv_loop_t *_loop)
+  :loop(_loop),
+   rxStream(_loop),
+   txStream(_loop)
+{
+  addRawMethod("handshake", [](ParentJsonPipeCall &call) {
+    return asJson(string("handshake"));
+  });
+}
+
+ParentJsonPipe::~ParentJsonPipe()
+{
+}
+
+void ParentJsonPipe::addRawMethod(string const &name, std::function< jsonstr(ParentJsonPipeCall &call) > const &f)
+{
+  methods[name] = f;
+}
+
+void ParentJsonPipe::start()
+{
+  int outFd = dup(1);
+  if (outFd < 0) throw runtime_error(string("dup(1): ") + strerror(errno));
+  if (dup2(2, 1) < 0) throw runtime_error(string("dup2(2, 1): ") + strerror(errno));
+
+  char const *shmName = getenv("TLBCORE_SHM");
+  if (shmName && *shmName) {
+    shm = make_shared< ShmFile >(shmName);
+  }
+  char const *framing = getenv("TLBCORE_PIPE_FRAMING");
+  if (framing && *framing) {
+    if (!strcmp(framing, "boxed")) {
+      boxed = true;
+    }
+    else if (strcmp(framing, "lines")) {
+      throw runtime_error(string("Unknown TLBCORE_PIPE_FRAMING ") + framing);
+    }
+  }
+
+  fromWorkers = make_unique< UvAsyncQueue >(loop);
+  txStream.pipe_init();
+  txStream.pipe_open(outFd);
+  rxStream.pipe_init();
+  rxStream.pipe_open(0);
+  rxStream.read_start([this](ssize_t nread, uv_buf_t const *buf) {
+    handleRx(nread, buf);
+  });
+}
+
+void ParentJsonPipe::run()
+{
+  start();
+  uv_run(loop, UV_RUN_DEFAULT);
+}
+
+void ParentJsonPipe::handleRx(ssize_t nread, uv_buf_t const *buf)
+{
+  if (nread < 0) {
+    if (nread != UV_EOF) eprintf("ParentJsonPipe: read: %s\n", uv_strerror((int)nread));
+    rxEof = true;
+    rxStream.read_stop();
+    maybeClose();
+    return;
+  }
+  size_t scanFrom = rxBuf.size();
+  rxBuf.append(buf->base, (size_t)nread);
+
+  if (boxed) {
+    size_t frameStart = 0;
+    while (rxBuf.size() - frameStart >= 4) {
+      U32 frameLen;
+      memcpy(&frameLen, &rxBuf[frameStart], sizeof(frameLen));
+      if (rxBuf.size() - frameStart - 4 < frameLen) break;
+      char *p = &rxBuf[frameStart + 4];
+      handleFrame(p, p + frameLen);
+      frameStart += 4 + frameLen;
+    }
+    if (frameStart > 0) rxBuf.erase(0, frameStart);
+    return;
+  }
+
+  // Handle all complete lines, then remove them from rxBuf at once
+  size_t lineStart = 0;
+  while (true) {
+    char *p = &rxBuf[0];
+    auto eol = static_cast< char * >(memchr(p + scanFrom, '\n', rxBuf.size() - scanFrom));
+    if (!eol) break;
+    handleLine(p + lineStart, eol);
+    lineStart = scanFrom = eol + 1 - p;
+  }
+  if (lineStart > 0) rxBuf.erase(0, lineStart);
+}
+
+// The line is terminated in place so the parser stops at the end of it
+void ParentJsonPipe::handleLine(char *b, char *e)
+{
+  *e = 0;
+  handleRequest(b, e, nullptr);
+}
+
+/*
+  A frame (without its length) as written by pipe_frames.encodeFrame: the length of the JSON
+  text, the text, and the attachment. The text is terminated in place while we parse it, which
+  clobbers the first byte after it, so that's put back after.
+*/
+void ParentJsonPipe::handleFrame(char *b, char *e)
+{
+  U32 textLen {0};
+  if (e - b >= 4) memcpy(&textLen, b, sizeof(textLen));
+  if (e - b < 4 || (size_t)(e - b - 4) < textLen) {
+    eprintf("ParentJsonPipe: bad frame\n");
+    return;
+  }
+  char *textEnd = b + 4 + textLen;
+  shared_ptr< ChunkMemory > attachment;
+  if (textEnd < e) {
+    attachment = make_shared< ChunkMemory >();
+    attachment->buf.assign(textEnd, e);
+  }
+  char save = *textEnd;
+  *textEnd = 0;
+  handleRequest(b + 4, textEnd, attachment);
+  *textEnd = save;
+}
+
+/*
+  Parse {"method":..., "params":[...], "id":...} and start the call. ndarrays in params refer
+  to the shared memory or the attachment.
+*/
+void ParentJsonPipe::handleRequest(char *b, char *e, shared_ptr< ChunkFile > const &attachment)
+{
+  auto call = make_shared< ParentJsonPipeCall >();
+  call->owner = this;
+
+  RdJsonContext ctx(b, nullptr, false);
+  ctx.endStr = e;
+  ctx.skipSpace();
+  if (*ctx.s == 0) return;
+  bool ok = true;
+  if (*ctx.s != '{') {
+    ok = ctx.fail(typeid(*call), "expected {");
+  }
+  else {
+    ctx.s++;
+    while (ok) {
+      ctx.skipSpace();
+      if (*ctx.s == '}') break;
+      string key;
+      if (!rdJson(ctx, key)) {
+        ok = false;
+        break;
+      }
+      ctx.skipSpace();
+      if (*ctx.s != ':') {
+        ok = ctx.fail(typeid(*call), "expected :");
+        break;
+      }
+      ctx.s++;
+      ctx.skipSpace();
+      if (key == "method") {
+        ok = rdJson(ctx, call->method);
+      }
+      else if (key == "params") {
+        ok = rdJson(ctx, call->params);
+      }
+      else if (key == "id") {
+        ok = rdJson(ctx, call->id);
+      }
+      else if (key == "shmAck" && shm) {
+        // The parent is done with the shared memory of these earlier responses
+        vector< jsonstr > acks;
+        ok = rdJson(ctx, acks);
+        for (auto &it : acks) {
+          shm->up.release(it.it);
+        }
+      }
+      else {
+        ok = ctx.skipValue();
+      }
+      ctx.skipSpace();
+      if (*ctx.s == ',') {
+        ctx.s++;
+      }
+      else if (*ctx.s != '}') {
+        ok = ctx.fail(typeid(*call), "expected , or }");
+      }
+    }
+  }
+  if (!ok) {
+    eprintf("ParentJsonPipe: bad request: %s\n", ctx.fmtFail().c_str());
+    return;
+  }
+
+  if (shm) {
+    call->blobs = make_shared< ChunkFileShm >(shm, call->id.it);
+    call->params.blobs = call->blobs;
+  }
+  else if (boxed) {
+    call->attachment = make_shared< ChunkMemory >();
+    call->blobs = call->attachment;
+    call->params.blobs = attachment;
+  }
+
+  auto methodIt = methods.find(call->method);
+  if (methodIt == methods.end()) {
+    eprintf("ParentJsonPipe: No such method %s\n", call->method.c_str());
+    if (!call->id.isNull()) tx(errorLine(call->id, "No such method"));
+    return;
+  }
+  // Not a copy, so mutable handlers keep their state between calls
+  auto *f = &methodIt->second;
+
+  outstanding++;
+  uvWork(loop,
+    [this, call, f](string &error, shared_ptr< void > &result) {
+      string line;
+      shared_ptr< ChunkMemory > attachment;
+      try {
+        line = resultLine(call->id, (*f)(*call));
+        attachment = call->attachment;
+      }
+      catch (exception const &ex) {
+        line = errorLine(call->id, ex.what());
+      }
+      // Through the same queue as progress, so it can't overtake it
+      fromWorkers->push([this, call, line, attachment]() {
+        if (!call->id.isNull()) tx(line, attachment);
+        finishCall();
+      });
+    },
+    [this, call](string const &error, shared_ptr< void > const &result) {
+      if (!error.empty()) { // The body didn't run
+        if (!call->id.isNull()) tx(errorLine(call->id, error));
+        finishCall();
+      }
+    });
+}
+
+void ParentJsonPipe::finishCall()
+{
+  outstanding--;
+  maybeClose();
+}
+
+void ParentJsonPipe::maybeClose()
+{
+  if (!rxEof || outstanding > 0 || closed) return;
+  closed = true;
+  fromWorkers->close();
+  rxStream.close();
+  txStream.shutdown([this](int status) {
+    txStream.close();
+  });
+}
+
+/*
+  Send a newline-terminated line, or with boxed framing, a frame with the line (without its
+  newline) and the attachment
+*/
+void ParentJsonPipe::tx(string const &line, shared_ptr< ChunkMemory > const &attachment)
+{
+  auto writeCb = [](int status) {
+    if (status < 0) eprintf("ParentJsonPipe: write: %s\n", uv_strerror(status));
+  };
+  if (!boxed) {
+    txStream.write(line, writeCb);
+    return;
+  }
+  size_t textLen = line.size() - 1;
+  size_t attachmentLen = attachment ? attachment->buf.size() : 0;
+  if (4 + textLen + attachmentLen > (size_t)numeric_limits< U32 >::max()) {
+    eprintf("ParentJsonPipe: frame too big (%zu bytes)\n", 4 + textLen + attachmentLen);
+    return;
+  }
+  U32 header[2] {(U32)(4 + textLen + attachmentLen), (U32)textLen};
+  vector< string > bufs {string(reinterpret_cast< char const * >(header), sizeof(header)), line.substr(0, textLen)};
+  if (attachmentLen) bufs.emplace_back(attachment->buf.begin(), attachment->buf.end());
+  txStream.write(bufs, writeCb);
+}
+
+void ParentJsonPipe::txFromWorker(string const &line)
+{
+  fromWorkers->push([this, line]() {
+    tx(line);
+  });
+}
+
+string ParentJsonPipe::resultLine(jsonstr const &id, jsonstr const &result)
+{
+  return "{\"id\":" + id.it + ",\"result\":" + result.it + ",\"error\":null}\n";
+}
+
+string ParentJsonPipe::errorLine(jsonstr const &id, string const &err)
+{
+  return "{\"id\":" + id.it + ",\"error\":" + asJson(err).it + "}\n";
+}
+
+string ParentJsonPipe::progressLine(jsonstr const &id, jsonstr const &result)
+{
+  return "{\"id\":" + id.it + ",\"error\":\"progress\",\"result\":" + result.it + "}\n";
+}
@@ -0,0 +1,239 @@
+#pragma once
+#include <tuple>
+#include "./jsonio.h"
+#include "./uv_wrappers.h"
+
+/*
+  The C++ side of ChildJsonPipe (child_pipe.js), like StdioServer in parent_pipe.py and
+  ParentJsonPipe in parent_pipe.js. It reads newline-delimited requests {method, params, id}
+  from stdin and writes responses {id, result, error} to stdout.
+
+  Handlers take a ParentJsonPipeCall & followed by the method's params, which are read
+  straight into their C++ types with rdJson. The return value is sent back with wrJson, or
+  null if the handler returns void. Throwing runtime_error sends the message as the error.
+  A handler can be a function pointer, a lambda (mutable or not), or a std::function. Generic
+  lambdas (with auto params) and other overloaded operator()s don't work, since the params
+  types have to be found from it.
+
+    uv_loop_t *loop = uv_default_loop();
+    ParentJsonPipe pp(loop);
+    pp.addMethod("test1", [](ParentJsonPipeCall &call, double v) {
+      return v + 1;
+    });
+    pp.addMethod("solve", [](ParentJsonPipeCall &call, arma::mat const &a, arma::vec const &b) {
+      call.progress(string("starting"));
+      return arma::vec(arma::solve(a, b));
+    });
+    pp.run();
+
+  Handlers run on libuv's thread pool (set UV_THREADPOOL_SIZE for more than 4 threads), so
+  they must be thread safe. Responses go out as each handler finishes, which can be out of
+  order; ChildJsonPipe matches them up by id. progress() can be called from the handler and
+  reaches the parent as cb('progress', result), always before the final result.
+
+  Stdout is moved to a new fd for the pipe, and fd 1 pointed at stderr, so stray printfs
+  don't corrupt the protocol.
+
+  When the parent was created with shareMem, it passes the name of a shared file in
+  $TLBCORE_SHM (see ShmFile in chunk_file.h). Then big arrays in params arrive as ndarrays
+  referring to the file, and big arrays (arma::Col, vector< double > ...) in results are
+  written there, falling back to text when it's full.
+
+  When the parent was created with framing: 'boxed' ($TLBCORE_PIPE_FRAMING=boxed), messages
+  are length-prefixed frames instead of lines, and big arrays go in each frame's binary
+  attachment instead (see pipe_frames.js).
+*/
+
+struct ParentJsonPipe;
+
+struct ParentJsonPipeCall {
+  ParentJsonPipe *owner {nullptr};
+  string method;
+  jsonstr id; // As sent. null for requests that don't want a reply
+  jsonstr params;
+  shared_ptr< ChunkFile > blobs; // In shared memory, when the parent set it up
+  shared_ptr< ChunkMemory > attachment; // The response's attachment, with boxed framing
+
+  template<typename T>
+  void progress(T const &result);
+
+  template<typename T>
+  jsonstr resultJson(T const &result);
+};
+
+/*
+  Find the params and return type of a handler, from its operator() or function type
+*/
+template<typename F>
+struct ParentJsonPipeHandlerTraits : ParentJsonPipeHandlerTraits< decltype(&F::operator()) > {
+};
+
+template<typename RET, typename... ARGS>
+struct ParentJsonPipeHandlerTraits< RET (*)(ParentJsonPipeCall &, ARGS...) > {
+  using Ret = RET;
+  using Params = std::tuple< typename std::decay< ARGS >::type... >;
+};
+
+template<typename C, typename RET, typename... ARGS>
+struct ParentJsonPipeHandlerTraits< RET (C::*)(ParentJsonPipeCall &, ARGS...) const > {
+  using Ret = RET;
+  using Params = std::tuple< typename std::decay< ARGS >::type... >;
+};
+
+// mutable lambdas
+template<typename C, typename RET, typename... ARGS>
+struct ParentJsonPipeHandlerTraits< RET (C::*)(ParentJsonPipeCall &, ARGS...) > {
+  using Ret = RET;
+  using Params = std::tuple< typename std::decay< ARGS >::type... >;
+};
+
+struct ParentJsonPipe {
+  explicit ParentJsonPipe(uv_loop_t *_loop);
+  ~ParentJsonPipe();
+  ParentJsonPipe(ParentJsonPipe const &) = delete;
+  ParentJsonPipe(ParentJsonPipe &&) = delete;
+  ParentJsonPipe & operator = (ParentJsonPipe const &) = delete;
+  ParentJsonPipe & operator = (ParentJsonPipe &&) = delete;
+
+  template<typename F>
+  void addMethod(string const &name, F f)
+  {
+    using Traits = ParentJsonPipeHandlerTraits< F >;
+    // mutable so f can be a mutable lambda. All calls share it, and can overlap on different threads
+    addRawMethod(name, [f](ParentJsonPipeCall &call) mutable {
+      typename Traits::Params params;
+      string err;
+      if (!rdJsonParams(call.params, params, err)) {
+        throw runtime_error(call.method + ": bad params: " + err);
+      }
+      return callWithParams(f, call, params,
+        std::make_index_sequence< std::tuple_size< typename Traits::Params >::value >(),
+        std::is_void< typename Traits::Ret >());
+    });
+  }
+
+  /*
+    A handler that takes the params and returns the result as JSON
+  */
+  void addRawMethod(string const &name, std::function< jsonstr(ParentJsonPipeCall &call) > const &f);
+
+  /*
+    Calls this.emit(...params) on the ChildJsonPipe in the parent. Call from the loop thread.
+  */
+  template<typename... ARGS>
+  void emitInParent(ARGS const &... params)
+  {
+    vector< jsonstr > p {asJson(params)...};
+    tx("{\"cmd\":\"emit\",\"params\":" + asJson(p).it + "}\n");
+  }
+
+  // Start reading requests, then run the loop until stdin closes and all calls finish
+  void start();
+  void run();
+
+  void handleRx(ssize_t nread, uv_buf_t const *buf);
+  void handleLine(char *b, char *e);
+  void handleFrame(char *b, char *e);
+  void handleRequest(char *b, char *e, shared_ptr< ChunkFile > const &attachment);
+  void finishCall();
+  void maybeClose();
+
+  void tx(string const &line, shared_ptr< ChunkMemory > const &attachment = nullptr);
+  void txFromWorker(string const &line);
+
+  static string resultLine(jsonstr const &id, jsonstr const &result);
+  static string errorLine(jsonstr const &id, string const &err);
+  static string progressLine(jsonstr const &id, jsonstr const &result);
+
+  template<typename... ARGS>
+  static bool rdJsonParams(jsonstr const &params, std::tuple< ARGS... > &args, string &err)
+  {
+    if (params.isNull() && sizeof...(ARGS) == 0) return true;
+    RdJsonContext ctx(params.it.c_str(), params.blobs, false);
+    ctx.endStr = ctx.s + params.it.size();
+    ctx.skipSpace();
+    if (*ctx.s != '[') {
+      err = "expected [";
+      return false;
+    }
+    ctx.s++;
+    bool ok = rdJsonParamsImpl(ctx, args, std::index_sequence_for< ARGS... >());
+    ctx.skipSpace();
+    if (ok && *ctx.s != ']') {
+      ok = ctx.fail(typeid(args), "expected ] after " + to_string(sizeof...(ARGS)) + " params");
+    }
+    if (!ok) {
+      err = ctx.fmtFail();
+      return false;
+    }
+    return true;
+  }
+
+  template<typename TUPLE, size_t... Is>
+  static bool rdJsonParamsImpl(RdJsonContext &ctx, TUPLE &args, std::index_sequence< Is... >)
+  {
+    bool ok = true;
+    int dummy[] = {0, (ok = ok && rdJsonParam(ctx, std::get< Is >(args), Is), 0)...};
+    (void)dummy;
+    return ok;
+  }
+
+  template<typename T>
+  static bool rdJsonParam(RdJsonContext &ctx, T &arg, size_t index)
+  {
+    ctx.skipSpace();
+    if (index > 0) {
+      if (*ctx.s != ',') return ctx.fail(typeid(arg), "expected more params");
+      ctx.s++;
+    }
+    ctx.skipSpace();
+    return rdJson(ctx, arg);
+  }
+
+  template<typename F, typename TUPLE, size_t... Is>
+  static jsonstr callWithParams(F &f, ParentJsonPipeCall &call, TUPLE &params, std::index_sequence< Is... >, std::false_type /* isVoid */)
+  {
+    return call.resultJson(f(call, std::get< Is >(params)...));
+  }
+
+  template<typename F, typename TUPLE, size_t... Is>
+  static jsonstr callWithParams(F &f, ParentJsonPipeCall &call, TUPLE &params, std::index_sequence< Is... >, std::true_type /* isVoid */)
+  {
+    f(call, std::get< Is >(params)...);
+    return jsonstr(); // null
+  }
+
+  uv_loop_t *loop {nullptr};
+  UvStream rxStream;
+  UvStream txStream;
+  unique_ptr< UvAsyncQueue > fromWorkers;
+  shared_ptr< ShmFile > shm;
+  bool boxed {false};
+  map< string, std::function< jsonstr(ParentJsonPipeCall &call) > > methods;
+  string rxBuf;
+  size_t outstanding {0};
+  bool rxEof {false};
+  bool closed {false};
+};
+
+template<typename T>
+void ParentJsonPipeCall::progress(T const &result)
+{
+  if (id.isNull()) return;
+  owner->txFromWorker(ParentJsonPipe::progressLine(id, asJson(result)));
+}
+
+template<typename T>
+jsonstr ParentJsonPipeCall::resultJson(T const &result)
+{
+  if (blobs && !id.isNull()) {
+    jsonstr ret;
+    ret.blobs = blobs;
+    toJson(ret, result);
+    ret.blobs = nullptr;
+    if (!blobs->errFlag) return ret;
+    // Out of shared memory, so send it all as text
+    if (owner->shm) owner->shm->up.release(id.it);
+  }
+  return asJson(result);
+}
@@ -6,6 +6,7 @@
 const _ = require('lodash');
 const async = require('async');
 const logio = require('../common/logio');
+const pipe_frames = require('./pipe_frames');
 
 exports.ParentJsonPipe = ParentJsonPipe;
 
@@ -17,7 +18,19 @@ function ParentJsonPipe(o, handlers) {
   }, handlers);
   this.stdin = process.stdin;
   this.stdout = process.stdout;
+  // Set by ChildJsonPipe's framing option. See pipe_frames.js
+  this.framing = process.env.TLBCORE_PIPE_FRAMING || 'lines';
+  this.frameMinBytes = o.frameMinBytes || 4096;
 
+  if (this.framing === 'boxed') {
+    let reader = new pipe_frames.FrameReader((rx) => {
+      this.handleRx(rx);
+    });
+    this.stdin.on('data', (buf) => {
+      reader.push(buf);
+    });
+    return;
+  }
   let datas = [];
   this.stdin.on('data', (buf) => {
     while (buf.length) {
@@ -37,6 +50,10 @@ function ParentJsonPipe(o, handlers) {
 }
 
 ParentJsonPipe.prototype.tx = function(tx) {
+  if (this.framing === 'boxed') {
+    for (let buf of pipe_frames.encodeFrame(tx, this.frameMinBytes)) this.stdout.write(buf);
+    return;
+  }
   this.stdout.write(JSON.stringify(tx));
   this.stdout.write('\n');
 };
@@ -1,4 +1,4 @@
-import sys, ujson, traceback
+import os, sys, struct, ujson, traceback
 
 class StdioServer(object):
 
@@ -6,6 +6,9 @@ class StdioServer(object):
         self.pipein = sys.stdin
         self.pipeout = sys.stdout
         sys.stdout = sys.stderr   # so print works
+        # Set by ChildJsonPipe's framing option. See pipe_frames.js
+        self.framing = os.environ.get('TLBCORE_PIPE_FRAMING', 'lines')
+        self.frame_min_bytes = 4096
 
     def run(self):
         while True:
@@ -34,13 +37,77 @@ class StdioServer(object):
         self.tx({'id': self.current_id, 'error': 'progress', result: result})
 
     def rx(self):
+        if self.framing == 'boxed': return self.rx_frame()
         rx_line = self.pipein.readline()
         if len(rx_line) == 0: return None # EOF
         msg = ujson.decode(rx_line)
         return msg
 
     def tx(self, msg):
+        if self.framing == 'boxed': return self.tx_frame(msg)
         tx_line = ujson.encode(msg, escape_forward_slashes=False)
         self.pipeout.write(tx_line)
         self.pipeout.write('\n')
         self.pipeout.flush()
+
+    def rx_frame(self):
+        """
+        Read a frame as written by pipe_frames.encodeFrame: lengths of the frame and of the
+        JSON text, the text, then the attachment. ndarrays in the attachment become numpy arrays.
+        """
+        hdr = self.pipein.buffer.read(4)
+        if len(hdr) < 4: return None # EOF
+        frame_len, = struct.unpack('<I', hdr)
+        frame = self.pipein.buffer.read(frame_len)
+        if len(frame) < frame_len: return None
+        text_len, = struct.unpack_from('<I', frame, 0)
+        msg = ujson.decode(frame[4:4+text_len].decode('utf8'))
+        if frame_len > 4 + text_len:
+            msg = self.load_ndarrays(msg, memoryview(frame)[4+text_len:])
+        return msg
+
+    def load_ndarrays(self, v, attachment):
+        if isinstance(v, dict):
+            if v.get('__type') == 'ndarray' and 'partOfs' in v:
+                import numpy
+                arr = numpy.frombuffer(attachment[v['partOfs'] : v['partOfs'] + v['partBytes']], dtype=v['dtype'])
+                return arr.reshape(v['shape']) if len(v['shape']) > 1 else arr
+            return {k: self.load_ndarrays(x, attachment) for k, x in v.items()}
+        if isinstance(v, list):
+            return [self.load_ndarrays(x, attachment) for x in v]
+        return v
+
+    def tx_frame(self, msg):
+        parts = []
+        msg = self.store_ndarrays(msg, parts, [0])
+        text = ujson.encode(msg, escape_forward_slashes=False).encode('utf8')
+        attachment_len = sum(len(p) for p in parts)
+        out = self.pipeout.buffer
+        out.write(struct.pack('<II', 4 + len(text) + attachment_len, len(text)))
+        out.write(text)
+        for p in parts:
+            out.write(p)
+        out.flush()
+
+    def store_ndarrays(self, v, parts, attachment_len):
+        """
+        Replace big numpy arrays with ndarrays, appending their bytes to parts.
+        If numpy isn't loaded, there can't be any.
+        """
+        numpy = sys.modules.get('numpy')
+        if numpy is not None and isinstance(v, numpy.ndarray):
+            if v.nbytes < self.frame_min_bytes:
+                return v.tolist()
+            data = numpy.ascontiguousarray(v).tobytes()
+            ret = {'__type': 'ndarray', 'partOfs': attachment_len[0], 'partBytes': len(data),
+                   'dtype': v.dtype.name, 'shape': list(v.shape)}
+            pad = -len(data) % 8
+            parts.append(data)
+            if pad: parts.append(b'\0' * pad)
+            attachment_len[0] += len(data) + pad
+            return ret
+        if isinstance(v, dict):
+            return {k: self.store_ndarrays(x, parts, attachment_len) for k, x in v.items()}
+        if isinstance(v, (list, tuple)):
+            return [self.store_ndarrays(x, parts, attachment_len) for x in v]
+        return v
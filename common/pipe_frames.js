@@ -0,0 +1,174 @@
+/*
+  Message formats shared by ChildJsonPipe (child_pipe.js) and ParentJsonPipe (parent_pipe.js).
+
+  Normally each message is a line of JSON. With framing: 'boxed', each message is a frame
+  like packet::to_file_boxed writes: a 4-byte little-endian length, then that many bytes of
+    4-byte little-endian length of the JSON text
+    the JSON text
+    an attachment section, possibly empty
+  Big typed arrays go in the attachment, and appear in the JSON as jsonio ndarrays
+  ({__type: 'ndarray', partOfs, partBytes, dtype, shape}) with partOfs counting from the start
+  of the attachment, the same as blobs in a jsonstr.
+*/
+'use strict';
+
+exports.stringifyWithNdarrays = stringifyWithNdarrays;
+exports.parseWithNdarrays = parseWithNdarrays;
+exports.encodeFrame = encodeFrame;
+exports.frameText = frameText;
+exports.FrameReader = FrameReader;
+
+const typedArrayDtypes = {
+  Float64Array: 'float64',
+  Float32Array: 'float32',
+  Uint8Array: 'uint8',
+  Uint8ClampedArray: 'uint8',
+  Uint16Array: 'uint16',
+  Uint32Array: 'uint32',
+  BigUint64Array: 'uint64',
+  Int8Array: 'int8',
+  Int16Array: 'int16',
+  Int32Array: 'int32',
+  BigInt64Array: 'int64',
+};
+
+const dtypeTypedArrays = {
+  float64: Float64Array,
+  float32: Float32Array,
+  uint8: Uint8Array,
+  uint16: Uint16Array,
+  uint32: Uint32Array,
+  uint64: BigUint64Array,
+  int8: Int8Array,
+  int16: Int16Array,
+  int32: Int32Array,
+  int64: BigInt64Array,
+};
+
+exports.typedArrayDtypes = typedArrayDtypes;
+exports.dtypeTypedArrays = dtypeTypedArrays;
+
+/*
+  JSON.stringify, calling storeArray(arr) for each typed array of at least minBytes. It
+  returns the partOfs where it stored it, or -1 to leave it in the JSON.
+  Node Buffers are typed arrays too, so they qualify.
+*/
+function stringifyWithNdarrays(value, minBytes, storeArray) {
+  return JSON.stringify(value, (k, v) => {
+    if (!ArrayBuffer.isView(v) || v.byteLength < minBytes) return v;
+    let dtype = typedArrayDtypes[v.constructor.name] || (Buffer.isBuffer(v) ? 'uint8' : null);
+    if (!dtype) return v;
+    let partOfs = storeArray(v);
+    if (partOfs < 0) return v;
+    // range is only needed for quantized dtypes, which we don't write
+    return {__type: 'ndarray', partOfs, partBytes: v.byteLength, dtype, shape: [v.length]};
+  });
+}
+
+/*
+  JSON.parse, with ndarrays turned into typed arrays. loadPart(partOfs, partBytes) returns a
+  Uint8Array of the bytes, or null if they're out of range. We make a view on it when it's
+  aligned, otherwise a copy. Multidimensional ones get a .shape property. Encoded dtypes
+  (see ndarray_encoding.h) are left as ndarrays.
+*/
+function parseWithNdarrays(text, loadPart) {
+  if (text.indexOf('"ndarray"') < 0) return JSON.parse(text);
+  return JSON.parse(text, (k, v) => {
+    if (!(v && v.__type === 'ndarray' && typeof v.partOfs === 'number')) return v;
+    let Ctor = dtypeTypedArrays[v.dtype];
+    if (!Ctor || !(v.partOfs >= 0 && v.partBytes >= 0) || v.partBytes % Ctor.BYTES_PER_ELEMENT) return v;
+    let bytes = loadPart(v.partOfs, v.partBytes);
+    if (!bytes) return v;
+    if (bytes.byteOffset % Ctor.BYTES_PER_ELEMENT) bytes = new Uint8Array(bytes);
+    let ret = new Ctor(bytes.buffer, bytes.byteOffset, v.partBytes / Ctor.BYTES_PER_ELEMENT);
+    if (v.shape && v.shape.length > 1) ret.shape = v.shape;
+    return ret;
+  });
+}
+
+/*
+  Make a boxed frame of msg, with typed arrays of at least minBytes in the attachment.
+  Returns an array of Buffers to write in order.
+*/
+function encodeFrame(msg, minBytes) {
+  let parts = [];
+  let attachmentBytes = 0;
+  let text = stringifyWithNdarrays(msg, minBytes, (arr) => {
+    let partOfs = attachmentBytes;
+    let pad = (8 - arr.byteLength % 8) % 8;
+    parts.push(Buffer.from(arr.buffer, arr.byteOffset, arr.byteLength));
+    if (pad) parts.push(Buffer.alloc(pad));
+    attachmentBytes += arr.byteLength + pad;
+    return partOfs;
+  });
+  return frameText(text, parts, attachmentBytes);
+}
+
+// Make a boxed frame of JSON text and attachment parts totalling attachmentBytes
+function frameText(text, parts, attachmentBytes) {
+  let textBuf = Buffer.from(text, 'utf8');
+  let header = Buffer.alloc(8);
+  header.writeUInt32LE(4 + textBuf.length + attachmentBytes, 0);
+  header.writeUInt32LE(textBuf.length, 4);
+  return [header, textBuf, ...parts];
+}
+
+/*
+  Collects data from a stream and calls onMessage(msg) for each boxed frame.
+  A frame split across chunks is assembled with one Buffer.concat. Frames contained in a
+  chunk are parsed in place, and typed arrays in the result are views on the chunk when aligned.
+  parseText(text, attachment) can replace parseWithNdarrays, when ndarrays refer elsewhere.
+*/
+function FrameReader(onMessage, parseText) {
+  this.onMessage = onMessage;
+  this.parseText = parseText || ((text, attachment) => {
+    return parseWithNdarrays(text, (partOfs, partBytes) => {
+      if (partOfs + partBytes > attachment.length) return null;
+      return attachment.subarray(partOfs, partOfs + partBytes);
+    });
+  });
+  this.bufs = [];
+  this.bufsLen = 0;
+}
+
+FrameReader.prototype.push = function(buf) {
+  if (this.bufs.length) {
+    this.bufs.push(buf);
+    this.bufsLen += buf.length;
+    if (this.bufsLen < 4) return;
+    if (this.bufs[0].length < 4) {
+      this.bufs = [Buffer.concat(this.bufs, this.bufsLen)];
+    }
+    let frameLen = 4 + this.bufs[0].readUInt32LE(0);
+    if (this.bufsLen < frameLen) return;
+    buf = Buffer.concat(this.bufs, this.bufsLen);
+    this.bufs = [];
+    this.bufsLen = 0;
+  }
+  let pos = 0;
+  while (buf.length - pos >= 4) {
+    let frameLen = 4 + buf.readUInt32LE(pos);
+    if (buf.length - pos < frameLen) break;
+    this.handleFrame(buf.subarray(pos + 4, pos + frameLen));
+    pos += frameLen;
+  }
+  if (pos < buf.length) {
+    this.bufs.push(buf.subarray(pos));
+    this.bufsLen = buf.length - pos;
+  }
+};
+
+FrameReader.prototype.handleFrame = function(frame) {
+  let msg;
+  try {
+    if (frame.length < 4) throw new Error('frame too short');
+    let textLen = frame.readUInt32LE(0);
+    if (4 + textLen > frame.length) throw new Error('bad text length');
+    msg = this.parseText(frame.toString('utf8', 4, 4 + textLen), frame.subarray(4 + textLen));
+  }
+  catch(ex) {
+    console.log('Error parsing frame', ex);
+    return;
+  }
+  this.onMessage(msg);
+};
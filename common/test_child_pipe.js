@@ -3,6 +3,7 @@
 const _ = require('lodash');
 const assert = require('assert');
 const path = require('path');
+const fs = require('fs');
 const async = require('async');
 const child_pipe = require('./child_pipe');
 const logio = require('../common/logio');
@@ -23,26 +24,87 @@ if (0) describe('ChildPipe.sshify', function() {
 const tlbcoreDir = path.dirname(__dirname);
 
 describe('ChildPipe', function() {
-  it('should work', function(done) {
+  _.each(['lines', 'boxed'], (framing) => {
+    it(`should work with ${framing} framing`, function(done) {
 
-    let cp1 = new child_pipe.ChildJsonPipe('python3', [path.join(tlbcoreDir, 'common/child_pipe_test_slave.py')], {}, {nChildren: 3, verbose: 0});
-    let cp2 = new child_pipe.ChildJsonPipe('node', [path.join(tlbcoreDir, 'common/child_pipe_test_slave.js')], {}, {nChildren: 2, verbose: 0});
-    async.each([cp1, cp2], (cp, done1) => {
+      let cp1 = new child_pipe.ChildJsonPipe('python3', [path.join(tlbcoreDir, 'common/child_pipe_test_slave.py')], {}, {nChildren: 3, verbose: 0, framing});
+      let cp2 = new child_pipe.ChildJsonPipe('node', [path.join(tlbcoreDir, 'common/child_pipe_test_slave.js')], {}, {nChildren: 2, verbose: 0, framing});
+      async.each([cp1, cp2], (cp, done1) => {
+        cp.handshake((err) => {
+          if (err) return done(err);
+          async.parallel([
+            (pdone) => {
+              async.each(_.range(10, 20), (baseNum, cb) => {
+                cp.rpc('test1', [baseNum], (err, v) => {
+                  if (0) console.log(baseNum, v);
+                  assert.equal(err, null);
+                  assert.equal(v, baseNum + 1);
+                  cb();
+                });
+              }, (err) => {
+                assert.equal(err, null);
+                pdone();
+              });
+            },
+            (pdone) => {
+              cp.rpc('testerr', [], (err) => {
+                assert.ok(err);
+                assert.equal(err.message, 'testerr always raises this error');
+                pdone();
+              });
+            },
+            (pdone) => {
+              cp.rpc('test2', ['abc', 'def', {'ghi': 'jkl', 'mno': {}}], (err, v) => {
+                assert.equal(err, null);
+                assert.deepEqual(v, [['abc', 'def', {'ghi': 'jkl', 'mno': {}}], 'foo']);
+                pdone();
+              });
+            }
+          ], (err) => {
+            if (err) return done1(err);
+            cp.close();
+            done1();
+          });
+        });
+      },
+      done);
+    });
+  });
+
+  it('should pass typed arrays with boxed framing', function(done) {
+    let cp = new child_pipe.ChildJsonPipe('node', [path.join(tlbcoreDir, 'common/child_pipe_test_slave.js')], {}, {nChildren: 1, verbose: 0, framing: 'boxed'});
+    let a = new Float64Array(10000);
+    for (let i = 0; i < a.length; i++) a[i] = i * 0.5;
+    cp.rpc('testarr', [a], (err, v) => {
+      assert.equal(err, null);
+      assert.ok(v[0] instanceof Float64Array);
+      assert.deepEqual(Array.from(v[0].subarray(0, 3)), [0, 1, 2]);
+      assert.equal(v[0][9999], 9999);
+      assert.equal(v[1], 10000);
+      cp.close();
+      done();
+    });
+  });
+});
+
+
+// Only if child_pipe_test_slave.cc has been built, since it needs a C++ toolchain
+const cppSlave = path.join(tlbcoreDir, 'build.src/child_pipe_test_slave');
+(fs.existsSync(cppSlave) ? describe : describe.skip)('ChildPipe with C++ child', function() {
+  _.each(['lines', 'boxed'], (framing) => {
+    it(`should work with ${framing} framing`, function(done) {
+      let cp = new child_pipe.ChildJsonPipe(cppSlave, [], {}, {nChildren: 2, verbose: 0, framing});
       cp.handshake((err) => {
         if (err) return done(err);
         async.parallel([
           (pdone) => {
             async.each(_.range(10, 20), (baseNum, cb) => {
               cp.rpc('test1', [baseNum], (err, v) => {
-                if (0) console.log(baseNum, v);
                 assert.equal(err, null);
                 assert.equal(v, baseNum + 1);
                 cb();
               });
-            }, (err) => {
-              assert.equal(err, null);
-              pdone();
-            });
+            }, pdone);
           },
           (pdone) => {
             cp.rpc('testerr', [], (err) => {
@@ -57,15 +119,64 @@ describe('ChildPipe', function() {
               assert.deepEqual(v, [['abc', 'def', {'ghi': 'jkl', 'mno': {}}], 'foo']);
               pdone();
             });
-          }
+          },
+          (pdone) => {
+            cp.rpc('testvoid', [1], (err, v) => {
+              assert.equal(err, null);
+              assert.strictEqual(v, null);
+              pdone();
+            });
+          },
+          (pdone) => {
+            cp.rpc('testfunc', ['ab'], (err, v) => {
+              assert.equal(err, null);
+              assert.equal(v, 'abab');
+              pdone();
+            });
+          },
         ], (err) => {
-          if (err) return done1(err);
           cp.close();
-          done1();
+          done(err);
+        });
+      });
+    });
+  });
+
+  it('should keep state in mutable handlers', function(done) {
+    let cp = new child_pipe.ChildJsonPipe(cppSlave, [], {}, {nChildren: 1, verbose: 0});
+    async.mapSeries(_.range(0, 5), (i, cb) => {
+      cp.rpc('testcount', [], cb);
+    }, (err, counts) => {
+      assert.equal(err, null);
+      assert.deepEqual(counts, [1, 2, 3, 4, 5]);
+      cp.close();
+      done();
+    });
+  });
+});
+
+
+describe('ChildPipe.maxInFlight', function() {
+  it('should queue calls beyond the window', function(done) {
+    let cp = new child_pipe.ChildJsonPipe('node', [path.join(tlbcoreDir, 'common/child_pipe_test_slave.js')], {}, {nChildren: 2, verbose: 0, maxInFlight: 1});
+    cp.handshake((err) => {
+      if (err) return done(err);
+      async.each(_.range(0, 20), (baseNum, cb) => {
+        cp.rpc('test1', [baseNum], (err, v) => {
+          assert.equal(err, null);
+          assert.equal(v, baseNum + 1);
+          cb();
         });
+        assert.ok(cp.inFlight[0].size <= 1 && cp.inFlight[1].size <= 1);
+      }, (err) => {
+        assert.equal(err, null);
+        let summary = cp.getLatencySummary();
+        assert.equal(summary.test1.count, 20);
+        assert.equal(summary.handshake.count, 2);
+        cp.close();
+        done();
       });
-    },
-    done);
+    });
   });
 });
 
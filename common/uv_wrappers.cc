@@ -103,9 +103,16 @@ UvAsyncQueue::UvAsyncQueue(uv_loop_t *_loop)
 
 UvAsyncQueue::~UvAsyncQueue()
 {
+  close();
+}
+
+void UvAsyncQueue::close()
+{
+  if (!async) return;
   uv_close(reinterpret_cast<uv_handle_t *>(async), [](uv_handle_t *async1) {
     delete reinterpret_cast<uv_async_t *>(async1);
   });
+  async = nullptr;
 }
 
 void UvAsyncQueue::async_init()
@@ -129,6 +136,7 @@ void UvAsyncQueue::async_init()
 void UvAsyncQueue::push(std::function< void() > const &f)
 {
   std::unique_lock< std::mutex > lock(workQueueMutex);
+  if (!async) throw runtime_error("UvAsyncQueue: push after close");
   workQueue.push_back(f);
   int rc = uv_async_send(async);
   if (rc < 0) throw uv_error("uv_async_send", rc);
@@ -249,6 +257,14 @@ void UvStream::tcp_open(uv_os_sock_t sock) {
 }
 
 
+void UvStream::pipe_open(uv_file fd) {
+  int rc;
+  assert(stream && stream->type == UV_NAMED_PIPE);
+  rc = uv_pipe_open(reinterpret_cast<uv_pipe_t *>(stream), fd);
+  if (rc < 0) throw uv_error("uv_pipe_open", rc);
+}
+
+
 void UvStream::udp_open(uv_os_sock_t sock) {
   int rc;
   assert(stream && stream->type == UV_UDP);
@@ -35,6 +35,8 @@ struct UvAsyncQueue {
 
   void async_init();
   void push(std::function< void() > const &f);
+  // Stop, so the loop can exit. Safe to call from a function run by the queue.
+  void close();
 
   std::mutex workQueueMutex;
   deque< std::function< void() > > workQueue;
@@ -53,6 +55,7 @@ struct UvStream {
   void tty_init(uv_file fd, int readable);
 
   void tcp_open(uv_os_sock_t sock);
+  void pipe_open(uv_file fd);
   void udp_open(uv_os_sock_t sock);
 
   void read_start(std::function< void(size_t suggested_size, uv_buf_t *buf) > const &_alloc_cb,
@@ -0,0 +1,194 @@
+#include "tlbcore/common/std_headers.h"
+#include "./fastrandom.h"
+#include <atomic>
+
+/*
+  Ziggurat tables, from Marsaglia & Tsang, "The Ziggurat Method for Generating Random Variables",
+  J. Stat. Software 5(8), 2000. 128 layers for the normal, 256 for the exponential.
+*/
+struct ZigguratTables {
+  ZigguratTables();
+
+  U32 kn[128];
+  double wn[128], fn[128];
+  U32 ke[256];
+  double we[256], fe[256];
+};
+
+ZigguratTables::ZigguratTables()
+{
+  double const m1 = 2147483648.0, m2 = 4294967296.0;
+
+  double dn = 3.442619855899, tn = dn, vn = 9.91256303526217e-3;
+  double q = vn / exp(-0.5*dn*dn);
+  kn[0] = (U32)((dn/q) * m1);
+  kn[1] = 0;
+  wn[0] = q/m1;
+  wn[127] = dn/m1;
+  fn[0] = 1.0;
+  fn[127] = exp(-0.5*dn*dn);
+  for (int i = 126; i >= 1; i--) {
+    dn = sqrt(-2.0 * log(vn/dn + exp(-0.5*dn*dn)));
+    kn[i+1] = (U32)((dn/tn) * m1);
+    tn = dn;
+    fn[i] = exp(-0.5*dn*dn);
+    wn[i] = dn/m1;
+  }
+
+  double de = 7.697117470131487, te = de, ve = 3.949659822581572e-3;
+  q = ve / exp(-de);
+  ke[0] = (U32)((de/q) * m2);
+  ke[1] = 0;
+  we[0] = q/m2;
+  we[255] = de/m2;
+  fe[0] = 1.0;
+  fe[255] = exp(-de);
+  for (int i = 254; i >= 1; i--) {
+    de = -log(ve/de + exp(-de));
+    ke[i+1] = (U32)((de/te) * m2);
+    te = de;
+    fe[i] = exp(-de);
+    we[i] = de/m2;
+  }
+}
+
+static ZigguratTables const zig;
+
+
+FastRandom::FastRandom(U64 seed)
+{
+  this->seed(seed, 0);
+}
+
+FastRandom::FastRandom(U64 seed, U64 stream)
+{
+  this->seed(seed, stream);
+}
+
+/*
+  Fill the state from seed with splitmix64, as recommended by the xoshiro authors, then
+  jump ahead to the requested stream.
+*/
+void FastRandom::seed(U64 seed, U64 stream)
+{
+  U64 x = seed;
+  for (auto &it : s) {
+    U64 z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    it = z ^ (z >> 31);
+  }
+  for (U64 i = 0; i < stream; i++) {
+    jump();
+  }
+}
+
+/*
+  Equivalent to 2^128 calls to next()
+*/
+void FastRandom::jump()
+{
+  static U64 const JUMP[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+
+  U64 s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for (auto jumpit : JUMP) {
+    for (int b = 0; b < 64; b++) {
+      if (jumpit & (1ULL << b)) {
+        s0 ^= s[0];
+        s1 ^= s[1];
+        s2 ^= s[2];
+        s3 ^= s[3];
+      }
+      next();
+    }
+  }
+  s[0] = s0;
+  s[1] = s1;
+  s[2] = s2;
+  s[3] = s3;
+}
+
+double FastRandom::normal()
+{
+  S32 hz = (S32)(next() >> 32);
+  U32 iz = hz & 127;
+  if ((U32)labs(hz) < zig.kn[iz]) return hz * zig.wn[iz];
+
+  double const r = 3.442619855899;
+  while (true) {
+    double x = hz * zig.wn[iz];
+    if (iz == 0) {
+      // Sample from the tail
+      double y;
+      do {
+        x = -log(uniformOpen()) / r;
+        y = -log(uniformOpen());
+      } while (y + y < x * x);
+      return (hz > 0) ? r + x : -r - x;
+    }
+    if (zig.fn[iz] + uniform() * (zig.fn[iz-1] - zig.fn[iz]) < exp(-0.5 * x * x)) return x;
+
+    hz = (S32)(next() >> 32);
+    iz = hz & 127;
+    if ((U32)labs(hz) < zig.kn[iz]) return hz * zig.wn[iz];
+  }
+}
+
+double FastRandom::exponential()
+{
+  U32 jz = (U32)(next() >> 32);
+  U32 iz = jz & 255;
+  if (jz < zig.ke[iz]) return jz * zig.we[iz];
+
+  while (true) {
+    if (iz == 0) return 7.697117470131487 - log(uniformOpen());
+    double x = jz * zig.we[iz];
+    if (zig.fe[iz] + uniform() * (zig.fe[iz-1] - zig.fe[iz]) < exp(-x)) return x;
+
+    jz = (U32)(next() >> 32);
+    iz = jz & 255;
+    if (jz < zig.ke[iz]) return jz * zig.we[iz];
+  }
+}
+
+void FastRandom::fillUniform(arma::vec &out)
+{
+  double *p = out.memptr();
+  for (size_t i = 0; i < out.n_elem; i++) {
+    p[i] = uniform();
+  }
+}
+
+void FastRandom::fillNormal(arma::vec &out)
+{
+  double *p = out.memptr();
+  for (size_t i = 0; i < out.n_elem; i++) {
+    p[i] = normal();
+  }
+}
+
+void FastRandom::fillExponential(arma::vec &out)
+{
+  double *p = out.memptr();
+  for (size_t i = 0; i < out.n_elem; i++) {
+    p[i] = exponential();
+  }
+}
+
+
+/*
+  Unless seeded explicitly, each thread gets its own stream off a fixed seed, numbered in the
+  order threads first ask for one.
+*/
+static std::atomic< U64 > threadRandomStreamCtr {0};
+
+FastRandom &threadRandom()
+{
+  thread_local FastRandom it(0x853c49e6748fea9bULL, threadRandomStreamCtr.fetch_add(1));
+  return it;
+}
+
+void seedThreadRandom(U64 seed, U64 stream)
+{
+  threadRandom().seed(seed, stream);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "./numerical.h"
+
+/*
+  Fast random numbers for Monte Carlo work.
+
+  frandom() and friends in hacks.h share libc's random() state, so they're slow and not
+  thread-safe. FastRandom is a small xoshiro256** generator (see http://prng.di.unimi.it/),
+  meant to be used one per thread. threadRandom() returns this thread's instance.
+  Normal and exponential variates use Marsaglia & Tsang's ziggurat method, which needs one
+  table lookup and a multiply almost all of the time.
+
+  For reproducible parallel runs, give every thread the same seed and a different stream number,
+  either with seedThreadRandom(seed, threadIndex) or by constructing FastRandom(seed, stream).
+  Streams are 2^128 outputs apart, so they never overlap.
+*/
+
+struct FastRandom {
+  explicit FastRandom(U64 seed = 0x853c49e6748fea9bULL);
+  FastRandom(U64 seed, U64 stream);
+
+  void seed(U64 seed, U64 stream = 0);
+  void jump();
+
+  U64 next()
+  {
+    U64 const result = rotl(s[1] * 5, 7) * 9;
+    U64 const t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  // Uniform in [0, 1)
+  double uniform()
+  {
+    return (double)(next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  // Uniform in (0, 1), safe to take the log of
+  double uniformOpen()
+  {
+    return ((double)(next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+  }
+
+  double normal();
+  double exponential();
+
+  void fillUniform(arma::vec &out);
+  void fillNormal(arma::vec &out);
+  void fillExponential(arma::vec &out);
+
+  static U64 rotl(U64 x, int k)
+  {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  U64 s[4];
+};
+
+FastRandom &threadRandom();
+void seedThreadRandom(U64 seed, U64 stream);
@@ -1,12 +1,16 @@
 #include "tlbcore/common/std_headers.h"
 #include "./haltonseq.h"
+#include "./fastrandom.h"
 
-// The 45 odd primes up to 200. It's hard to imagine wanting more than 45 axes
+/*
+  The 46 odd primes up to 211. It's hard to imagine wanting more than 46 axes.
+  Keep the count even, since gaussianHaltonRow uses them in pairs.
+*/
 static vector< u_int > haltonAxes {
-  3,5,7,11,13,17,19,23,27,29,31,37,41,43,47,
+  3,5,7,11,13,17,19,23,29,31,37,41,43,47,
     53,59,61,67,71,73,79,83,89,97,
     101,103,107,109,113,127,131,137,139,149,
-    151,157,163,167,173,179,181,191,193,197,199};
+    151,157,163,167,173,179,181,191,193,197,199,211};
 
 /*
   Return the (i)th number in the halton sequence of the given (radix)
@@ -14,13 +18,14 @@ static vector< u_int > haltonAxes {
 */
 double unipolarHaltonAxis(u_int i, u_int radix)
 {
-  if (i == 0) return 0.0;
-  int digit = int(i % radix);
-
-  double digitValue = digit;
+  double ret = 0.0;
   double placeValue = 1.0/radix;
-
-  return (digitValue + unipolarHaltonAxis(i/radix, radix)) * placeValue;
+  while (i > 0) {
+    ret += (i % radix) * placeValue;
+    i /= radix;
+    placeValue /= radix;
+  }
+  return ret;
 }
 
 /*
@@ -31,7 +36,7 @@ arma::vec unipolarHaltonRow(u_int i, size_t nCols)
   assert (nCols <= haltonAxes.size());
   arma::vec ret(nCols);
   for (size_t ci = 0; ci < nCols; ci++) {
-    ret[ci] = unipolarHaltonAxis(i, haltonAxes[i]);
+    ret[ci] = unipolarHaltonAxis(i, haltonAxes[ci]);
   }
   return ret;
 }
@@ -40,15 +45,21 @@ arma::vec unipolarHaltonRow(u_int i, size_t nCols)
   Return the (i)th number in the bipolar halton sequence of the given (radix)
   This approximates a uniform distribution in [-1..1]
 */
-double bipolarHaltonAxis(u_int i, u_int radix)
+static inline double bipolarDigitValue(u_int digit)
 {
-  if (i == 0) return 0.0;
-  int digit = int(i % radix);
+  return (1 - int(digit%2) * 2) * int((digit + 1) / 2) * 2.0;
+}
 
-  double digitValue = (1 - (digit%2) * 2) * ((digit + 1) / 2) * 2.0;
+double bipolarHaltonAxis(u_int i, u_int radix)
+{
+  double ret = 0.0;
   double placeValue = 1.0/radix;
-
-  return (digitValue + bipolarHaltonAxis(i/radix, radix)) * placeValue;
+  while (i > 0) {
+    ret += bipolarDigitValue(i % radix) * placeValue;
+    i /= radix;
+    placeValue /= radix;
+  }
+  return ret;
 }
 
 arma::vec bipolarHaltonRow(u_int i, size_t nCols)
@@ -56,7 +67,7 @@ arma::vec bipolarHaltonRow(u_int i, size_t nCols)
   assert (nCols <= haltonAxes.size());
   arma::vec ret(nCols);
   for (size_t ci = 0; ci < nCols; ci++) {
-    ret[ci] = bipolarHaltonAxis(i, haltonAxes[i]);
+    ret[ci] = bipolarHaltonAxis(i, haltonAxes[ci]);
   }
   return ret;
 }
@@ -74,7 +85,8 @@ static arma::cx_double boxMullerTransform(double u1, double u2) {
 
 arma::vec gaussianHaltonRow(u_int i, size_t nCols)
 {
-  assert (nCols <= haltonAxes.size());
+  // An odd nCols still uses a whole pair of axes
+  if (((nCols + 1) & ~(size_t)1) > haltonAxes.size()) throw runtime_error("gaussianHaltonRow: too many columns");
   arma::vec ret(nCols);
   for (size_t ci = 0; ci < nCols; ci+=2) {
     double u1 = unipolarHaltonAxis(i+1, haltonAxes[ci+0]);
@@ -85,3 +97,214 @@ arma::vec gaussianHaltonRow(u_int i, size_t nCols)
   }
   return ret;
 }
+
+
+/* ----------------------------------------------------------------------
+   HaltonGenerator
+*/
+
+HaltonGenerator::HaltonGenerator(size_t _nCols, bool _bipolar, u_int _index, U64 _scrambleSeed)
+  :nCols(_nCols),
+   bipolar(_bipolar),
+   scrambleSeed(_scrambleSeed)
+{
+  if (nCols > haltonAxes.size()) throw runtime_error("HaltonGenerator: too many columns");
+  axes.resize(nCols);
+  for (size_t ci = 0; ci < nCols; ci++) {
+    auto &ax = axes[ci];
+    ax.radix = haltonAxes[ci];
+    double placeValue = 1.0;
+    for (size_t k = 0; k < HaltonAxisState::MAX_DIGITS; k++) {
+      placeValue /= ax.radix;
+      ax.placeValues[k] = placeValue;
+    }
+    if (scrambleSeed) {
+      // A random permutation of the digits, keeping 0 fixed so trailing zeros still contribute nothing
+      FastRandom rng(scrambleSeed + ci * 0x9e3779b97f4a7c15ULL);
+      ax.perm.resize(ax.radix);
+      for (u_int d = 0; d < ax.radix; d++) ax.perm[d] = d;
+      for (u_int d = ax.radix - 1; d > 1; d--) {
+        swap(ax.perm[d], ax.perm[1 + rng.next() % d]);
+      }
+    }
+  }
+  seek(_index);
+}
+
+void HaltonGenerator::seek(u_int _index)
+{
+  index = _index;
+  for (auto &ax : axes) {
+    u_int i = index;
+    for (size_t k = 0; k < HaltonAxisState::MAX_DIGITS; k++) {
+      ax.digits[k] = i % ax.radix;
+      i /= ax.radix;
+    }
+    updateHigh(ax);
+  }
+}
+
+/*
+  Sum the contributions of all but the lowest digit. Only needed when a carry happens,
+  so once every radix steps.
+*/
+double HaltonGenerator::digitValue(HaltonAxisState const &ax, u_int digit) const
+{
+  if (!ax.perm.empty()) digit = ax.perm[digit];
+  return bipolar ? bipolarDigitValue(digit) : (double)digit;
+}
+
+void HaltonGenerator::updateHigh(HaltonAxisState &ax)
+{
+  double high = 0.0;
+  for (size_t k = HaltonAxisState::MAX_DIGITS; k-- > 1; ) {
+    if (ax.digits[k] == 0) continue;
+    high += digitValue(ax, ax.digits[k]) * ax.placeValues[k];
+  }
+  ax.high = high;
+}
+
+/*
+  Write n consecutive values of one axis to out, and advance it by n.
+  The lowest digit just counts; when it wraps, propagate the carry and recompute the rest.
+*/
+void HaltonGenerator::fillAxis(HaltonAxisState &ax, double *out, size_t n)
+{
+  u_int radix = ax.radix;
+  double pv0 = ax.placeValues[0];
+  u_int d0 = ax.digits[0];
+  size_t ri = 0;
+  while (ri < n) {
+    size_t run = min(n - ri, (size_t)(radix - d0));
+    double high = ax.high;
+    if (!ax.perm.empty()) {
+      for (size_t j = 0; j < run; j++) {
+        out[ri + j] = high + digitValue(ax, d0 + (u_int)j) * pv0;
+      }
+    }
+    else if (bipolar) {
+      for (size_t j = 0; j < run; j++) {
+        out[ri + j] = high + bipolarDigitValue(d0 + (u_int)j) * pv0;
+      }
+    } else {
+      for (size_t j = 0; j < run; j++) {
+        out[ri + j] = high + (double)(d0 + (u_int)j) * pv0;
+      }
+    }
+    ri += run;
+    d0 += (u_int)run;
+    if (d0 == radix) {
+      d0 = 0;
+      for (size_t k = 1; k < HaltonAxisState::MAX_DIGITS; k++) {
+        if (++ax.digits[k] < radix) break;
+        ax.digits[k] = 0;
+      }
+      updateHigh(ax);
+    }
+  }
+  ax.digits[0] = d0;
+}
+
+/*
+  Fill rows [rowLo, rowHi) of out with the next points. Each axis is generated down its own
+  column, so writes are contiguous.
+*/
+void HaltonGenerator::fillRows(arma::mat &out, size_t rowLo, size_t rowHi)
+{
+  if (out.n_cols != nCols) throw runtime_error("HaltonGenerator: wrong number of columns");
+  if (rowHi > out.n_rows || rowLo > rowHi) throw runtime_error("HaltonGenerator: bad row range");
+  for (size_t ci = 0; ci < nCols; ci++) {
+    fillAxis(axes[ci], out.colptr(ci) + rowLo, rowHi - rowLo);
+  }
+  index += (u_int)(rowHi - rowLo);
+}
+
+void HaltonGenerator::fill(arma::mat &out)
+{
+  fillRows(out, 0, out.n_rows);
+}
+
+void HaltonGenerator::next(arma::vec &out)
+{
+  out.set_size(nCols);
+  for (size_t ci = 0; ci < nCols; ci++) {
+    fillAxis(axes[ci], out.memptr() + ci, 1);
+  }
+  index++;
+}
+
+/*
+  Like fill, but split into chunks of rows, each generated on its own thread by a generator
+  seeked to the chunk's first index. Gives the same result as fill.
+  pe limits how many chunks run at once. Only our own threads are joined, so other work the
+  caller has pushed to pe keeps running.
+*/
+void HaltonGenerator::fillParallel(arma::mat &out, ParEngine &pe, size_t chunkRows)
+{
+  if (out.n_cols != nCols) throw runtime_error("HaltonGenerator: wrong number of columns");
+  if (chunkRows == 0) chunkRows = out.n_rows;
+  u_int startIndex = index;
+  ParEngine chunks; // Just for joining. The threads reserve from pe
+  for (size_t rowLo = 0; rowLo < out.n_rows; rowLo += chunkRows) {
+    size_t rowHi = min((size_t)out.n_rows, rowLo + chunkRows);
+    arma::mat *outp = &out;
+    HaltonGenerator const *proto = this;
+    chunks.push(thread([outp, proto, startIndex, rowLo, rowHi, &pe]() {
+      ParEngineRsv rsv(&pe, 0);
+      HaltonGenerator gen(*proto);
+      gen.seek(startIndex + (u_int)rowLo);
+      gen.fillRows(*outp, rowLo, rowHi);
+    }));
+  }
+  chunks.finish();
+  seek(startIndex + (u_int)out.n_rows);
+}
+
+
+/*
+  Box-Muller over a whole block. Column pairs (0,1), (2,3), ... of uniform become the same
+  columns of normal. uniform needs normal.n_cols rounded up to even columns.
+  The inner loop has no dependencies between rows, so with -O3 -ffast-math it can use
+  glibc's vector log/sin/cos.
+*/
+void boxMullerBlock(arma::mat const &uniform, arma::mat &normal)
+{
+  size_t nRows = normal.n_rows, nCols = normal.n_cols;
+  if (uniform.n_rows != nRows || uniform.n_cols < ((nCols + 1) & ~(size_t)1)) {
+    throw runtime_error("boxMullerBlock: uniform block too small");
+  }
+  double const tiny = 1.0 / 8589934592.0; // Keeps log finite if a sequence hits exactly 0
+
+  for (size_t ci = 0; ci < nCols; ci += 2) {
+    double const *u1 = uniform.colptr(ci);
+    double const *u2 = uniform.colptr(ci+1);
+    double *z0 = normal.colptr(ci);
+    if (ci+1 < nCols) {
+      double *z1 = normal.colptr(ci+1);
+      for (size_t ri = 0; ri < nRows; ri++) {
+        double factor = sqrt(-2.0 * log(max(u1[ri], tiny)));
+        double theta = 2.0 * M_PI * u2[ri];
+        z0[ri] = cos(theta) * factor;
+        z1[ri] = sin(theta) * factor;
+      }
+    } else {
+      for (size_t ri = 0; ri < nRows; ri++) {
+        double factor = sqrt(-2.0 * log(max(u1[ri], tiny)));
+        z0[ri] = cos(2.0 * M_PI * u2[ri]) * factor;
+      }
+    }
+  }
+}
+
+/*
+  Fill out with rows startIndex .. startIndex + out.n_rows of gaussianHaltonRow.
+  With a nonzero scrambleSeed, uses permuted Halton digits.
+*/
+void gaussianHaltonBlock(arma::mat &out, u_int startIndex, U64 scrambleSeed)
+{
+  size_t nUniform = (out.n_cols + 1) & ~(size_t)1;
+  HaltonGenerator gen(nUniform, false, startIndex + 1, scrambleSeed);
+  arma::mat uniform(out.n_rows, nUniform);
+  gen.fill(uniform);
+  boxMullerBlock(uniform, out);
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "./numerical.h"
+#include "../common/parengine.h"
 /*
   Generate Halton sequences
   See http://en.wikipedia.org/wiki/Halton_sequence
@@ -9,3 +10,46 @@ arma::vec unipolarHaltonRow(u_int i, size_t nCols);
 double bipolarHaltonAxis(u_int i, u_int radix);
 arma::vec bipolarHaltonRow(u_int i, size_t nCols);
 arma::vec gaussianHaltonRow(u_int i, size_t nCols);
+
+/*
+  Generate consecutive Halton points incrementally, straight into a preallocated matrix with
+  one point per row. Rather than computing every index from scratch, each axis keeps its
+  digits and only redoes the sum when the lowest digit carries (Struckmeier's method).
+  So a point costs about one add per axis.
+  Results match unipolarHaltonRow / bipolarHaltonRow to within rounding.
+
+  With a nonzero scrambleSeed, each axis's digits go through a random permutation (fixing 0),
+  which removes most of the correlation between the higher axes. For more than 46 axes, use
+  SobolGenerator in sobolseq.h.
+*/
+struct HaltonAxisState {
+  static const size_t MAX_DIGITS = 21; // enough for any u_int in radix 3
+  u_int radix;
+  u_int digits[MAX_DIGITS];
+  double placeValues[MAX_DIGITS];
+  double high;
+  vector< u_int > perm;
+};
+
+struct HaltonGenerator {
+  explicit HaltonGenerator(size_t _nCols, bool _bipolar = false, u_int _index = 0, U64 _scrambleSeed = 0);
+
+  void seek(u_int _index);
+  void next(arma::vec &out);
+  void fill(arma::mat &out);
+  void fillRows(arma::mat &out, size_t rowLo, size_t rowHi);
+  void fillParallel(arma::mat &out, ParEngine &pe, size_t chunkRows = 65536);
+
+  double digitValue(HaltonAxisState const &ax, u_int digit) const;
+  void updateHigh(HaltonAxisState &ax);
+  void fillAxis(HaltonAxisState &ax, double *out, size_t n);
+
+  size_t nCols;
+  bool bipolar;
+  U64 scrambleSeed;
+  u_int index;
+  vector< HaltonAxisState > axes;
+};
+
+void boxMullerBlock(arma::mat const &uniform, arma::mat &normal);
+void gaussianHaltonBlock(arma::mat &out, u_int startIndex, U64 scrambleSeed = 0);
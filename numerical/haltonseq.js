@@ -7,10 +7,10 @@ exports.boxMullerTransform = boxMullerTransform;
 exports.gaussianHaltonRow = gaussianHaltonRow;
 
 const haltonAxes  = [
-  3,5,7,11,13,17,19,23,27,29,31,37,41,43,47,
+  3,5,7,11,13,17,19,23,29,31,37,41,43,47,
   53,59,61,67,71,73,79,83,89,97,
   101,103,107,109,113,127,131,137,139,149,
-  151,157,163,167,173,179,181,191,193,197,199
+  151,157,163,167,173,179,181,191,193,197,199,211
 ];
 
 /*
@@ -36,7 +36,7 @@ function unipolarHaltonRow(i, nCols)
   if (nCols > haltonAxes.length) throw new Error("nCols too large");
   let ret = [];
   for (let ci = 0; ci < nCols; ci++) {
-    ret.push(unipolarHaltonAxis(i, haltonAxes[i]));
+    ret.push(unipolarHaltonAxis(i, haltonAxes[ci]));
   }
   return ret;
 }
@@ -61,7 +61,7 @@ function bipolarHaltonRow(i, nCols)
   if (nCols > haltonAxes.length) throw new Error("nCols too large");
   let ret = [];
   for (let ci = 0; ci < nCols; ci++) {
-    ret.push(bipolarHaltonAxis(i, haltonAxes[i]));
+    ret.push(bipolarHaltonAxis(i, haltonAxes[ci]));
   }
   return ret;
 }
@@ -79,7 +79,8 @@ function boxMullerTransform(u1, u2) {
 
 function gaussianHaltonRow(i, nCols)
 {
-  if (nCols > haltonAxes.length) throw new Error("nCols too large");
+  // An odd nCols still uses a whole pair of axes
+  if (((nCols + 1) & ~1) > haltonAxes.length) throw new Error("nCols too large");
   let ret = [];
   for (let ci = 0; ci < nCols; ci+=2) {
     let u1 = unipolarHaltonAxis(i+1, haltonAxes[ci+0]);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <armadillo>
+#include <thread>
+#include "../common/parengine.h"
 
 static inline double normangle(double x) {
   if (x > M_PI) {
@@ -89,14 +91,106 @@ map<string, T> linearComb(double aCoeff, map< string, T > const &a, double bCoef
   return aCoeff > bCoeff ? a : b;
 }
 
+
+/*
+  linearCombInto(out, aCoeff, a, bCoeff, b) sets out = aCoeff*a + bCoeff*b, reusing out's storage.
+  out may be the same object as a or b, so linearCombInto(x, 1.0, x, alpha, y) is an axpy.
+  Types without their own overload fall back to assigning from linearComb.
+*/
+
 template<typename T>
-vector< T > linearComb(double aCoeff, vector< T > const &a, double bCoeff, vector< T > const &b)
+void linearCombInto(T &out, double aCoeff, T const &a, double bCoeff, T const &b)
+{
+  out = linearComb(aCoeff, a, bCoeff, b);
+}
+
+static inline void linearCombInto(double &out, double aCoeff, double const &a, double bCoeff, double const &b)
+{
+  out = aCoeff*a + bCoeff*b;
+}
+static inline void linearCombInto(float &out, double aCoeff, float const &a, double bCoeff, float const &b)
+{
+  out = aCoeff*a + bCoeff*b;
+}
+static inline void linearCombInto(S64 &out, double aCoeff, S64 const &a, double bCoeff, S64 const &b)
+{
+  out = S64(aCoeff * (double)a + bCoeff * (double)b);
+}
+static inline void linearCombInto(S32 &out, double aCoeff, S32 const &a, double bCoeff, S32 const &b)
+{
+  out = S32(aCoeff * (double)a + bCoeff * (double)b);
+}
+static inline void linearCombInto(U64 &out, double aCoeff, U64 const &a, double bCoeff, U64 const &b)
+{
+  out = U64(aCoeff * (double)a + bCoeff * (double)b);
+}
+static inline void linearCombInto(U32 &out, double aCoeff, U32 const &a, double bCoeff, U32 const &b)
+{
+  out = U32(aCoeff * (double)a + bCoeff * (double)b);
+}
+
+static inline void linearCombInto(string &out, double aCoeff, string const &a, double bCoeff, string const &b)
+{
+  string const &sel = aCoeff > bCoeff ? a : b;
+  if (&out != &sel) out = sel;
+}
+
+/*
+  The loop for contiguous data. It's written without __restrict since out may alias x or y,
+  but compilers still vectorize it after a runtime overlap check.
+*/
+template<typename T>
+void linearCombKernel(T *out, double aCoeff, T const *x, double bCoeff, T const *y, size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    out[i] = T(aCoeff * x[i] + bCoeff * y[i]);
+  }
+}
+
+template<typename T>
+void linearCombInto(arma::Col< T > &out, double aCoeff, arma::Col< T > const &a, double bCoeff, arma::Col< T > const &b)
+{
+  assert(a.n_elem == b.n_elem);
+  if (out.n_elem != a.n_elem) out.set_size(a.n_elem);
+  linearCombKernel(out.memptr(), aCoeff, a.memptr(), bCoeff, b.memptr(), a.n_elem);
+}
+template<typename T>
+void linearCombInto(arma::Mat< T > &out, double aCoeff, arma::Mat< T > const &a, double bCoeff, arma::Mat< T > const &b)
+{
+  assert(a.n_rows == b.n_rows && a.n_cols == b.n_cols);
+  if (out.n_rows != a.n_rows || out.n_cols != a.n_cols) out.set_size(a.n_rows, a.n_cols);
+  linearCombKernel(out.memptr(), aCoeff, a.memptr(), bCoeff, b.memptr(), a.n_elem);
+}
+template<typename T>
+void linearCombInto(arma::Row< T > &out, double aCoeff, arma::Row< T > const &a, double bCoeff, arma::Row< T > const &b)
+{
+  assert(a.n_elem == b.n_elem);
+  if (out.n_elem != a.n_elem) out.set_size(a.n_elem);
+  linearCombKernel(out.memptr(), aCoeff, a.memptr(), bCoeff, b.memptr(), a.n_elem);
+}
+
+template<typename T>
+void linearCombInto(map< string, T > &out, double aCoeff, map< string, T > const &a, double bCoeff, map< string, T > const &b)
+{
+  map< string, T > const &sel = aCoeff > bCoeff ? a : b;
+  if (&out != &sel) out = sel;
+}
+
+template<typename T>
+void linearCombInto(vector< T > &out, double aCoeff, vector< T > const &a, double bCoeff, vector< T > const &b)
 {
   assert(a.size() == b.size());
-  vector< T > ret(a.size());
+  if (out.size() != a.size()) out.resize(a.size());
   for (size_t i = 0; i < a.size(); i++) {
-    ret[i] = linearComb(aCoeff, a[i], bCoeff, b[i]);
+    linearCombInto(out[i], aCoeff, a[i], bCoeff, b[i]);
   }
+}
+
+template<typename T>
+vector< T > linearComb(double aCoeff, vector< T > const &a, double bCoeff, vector< T > const &b)
+{
+  vector< T > ret;
+  linearCombInto(ret, aCoeff, a, bCoeff, b);
   return ret;
 }
 
@@ -151,36 +245,125 @@ double linearMetric(arma::Row< T > const &a, arma::Row< T > const &b)
 
 
 
+/*
+  Dot product of contiguous data. Four separate sums let the compiler vectorize without
+  -ffast-math, since it doesn't have to keep the additions in order.
+*/
 template<typename T>
-double linearMetric(map< string, T > const &a, map< string, T > const &b)
-{
-  set< string > keys;
-  for (auto const &it : a) {
-    keys.insert(it.first);
+double linearMetricKernel(T const *x, T const *y, size_t n)
+{
+  double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += (double)x[i+0] * (double)y[i+0];
+    s1 += (double)x[i+1] * (double)y[i+1];
+    s2 += (double)x[i+2] * (double)y[i+2];
+    s3 += (double)x[i+3] * (double)y[i+3];
   }
-  for (auto const &it : b) {
-    keys.insert(it.first);
+  for (; i < n; i++) {
+    s0 += (double)x[i] * (double)y[i];
   }
+  return (s0 + s1) + (s2 + s3);
+}
+
+/*
+  Sum of linearMetric over elements [lo, hi). Elements past the end of the shorter vector
+  count as zero.
+*/
+static inline double linearMetricRange(vector< double > const &a, vector< double > const &b, size_t lo, size_t hi)
+{
+  hi = min(hi, min(a.size(), b.size()));
+  return lo < hi ? linearMetricKernel(a.data() + lo, b.data() + lo, hi - lo) : 0.0;
+}
+static inline double linearMetricRange(vector< float > const &a, vector< float > const &b, size_t lo, size_t hi)
+{
+  hi = min(hi, min(a.size(), b.size()));
+  return lo < hi ? linearMetricKernel(a.data() + lo, b.data() + lo, hi - lo) : 0.0;
+}
+static inline double linearMetric(vector< double > const &a, vector< double > const &b)
+{
+  return linearMetricRange(a, b, 0, a.size());
+}
+static inline double linearMetric(vector< float > const &a, vector< float > const &b)
+{
+  return linearMetricRange(a, b, 0, a.size());
+}
+
+// So vectors of maps and maps of vectors can find each other
+template<typename T> double linearMetric(vector< T > const &a, vector< T > const &b);
+template<typename T> double linearMetric(map< string, T > const &a, map< string, T > const &b);
+
+template<typename T>
+double linearMetricRange(vector< T > const &a, vector< T > const &b, size_t lo, size_t hi)
+{
   double ret = 0.0;
-  for (auto const &it : keys) {
-    auto ait = a.find(it);
-    auto bit = b.find(it);
-    ret += linearMetric((ait == a.end() ? T() : ait->second), (bit == b.end() ? T() : bit->second));
+  for (size_t i = lo; i < hi; i++) {
+    ret += linearMetric(i < a.size() ? a[i]: T(), i < b.size() ? b[i] : T());
   }
-  return 0.0;
+  return ret;
 }
 
 template<typename T>
 double linearMetric(vector< T > const &a, vector< T > const &b)
 {
-  auto size = max(a.size(), b.size());
+  return linearMetricRange(a, b, 0, max(a.size(), b.size()));
+}
+
+/*
+  Both maps are sorted by key, so walk them together. A key in only one map is paired with
+  a zero value, so it contributes nothing.
+*/
+template<typename T>
+double linearMetric(map< string, T > const &a, map< string, T > const &b)
+{
   double ret = 0.0;
-  for (size_t i = 0; i < size; i++) {
-    ret += linearMetric(i < a.size() ? a[i]: T(), i < b.size() ? b[i] : T());
+  auto ait = a.begin();
+  auto bit = b.begin();
+  while (ait != a.end() && bit != b.end()) {
+    int cmp = ait->first.compare(bit->first);
+    if (cmp < 0) {
+      ++ait;
+    }
+    else if (cmp > 0) {
+      ++bit;
+    }
+    else {
+      ret += linearMetric(ait->second, bit->second);
+      ++ait;
+      ++bit;
+    }
   }
   return ret;
 }
 
+/*
+  linearMetric over a large vector, split into chunks on separate threads. Chunk sums are
+  added in order, so the result doesn't depend on scheduling, though it can differ from
+  linearMetric in the last few bits. Small vectors just use linearMetric.
+*/
+template<typename T>
+double linearMetricParallel(vector< T > const &a, vector< T > const &b, size_t nThreads = 0, size_t minChunk = 65536)
+{
+  size_t size = max(a.size(), b.size());
+  if (!nThreads) nThreads = thread::hardware_concurrency();
+  size_t nChunks = min(nThreads, size / max(minChunk, (size_t)1));
+  if (nChunks <= 1) return linearMetric(a, b);
+
+  vector< double > partial(nChunks, 0.0);
+  ParEngine pe(nChunks);
+  size_t chunkSize = (size + nChunks - 1) / nChunks;
+  for (size_t ci = 0; ci < nChunks; ci++) {
+    pe.push(thread([&a, &b, &partial, ci, chunkSize, size]() {
+      partial[ci] = linearMetricRange(a, b, ci * chunkSize, min(size, (ci + 1) * chunkSize));
+    }));
+  }
+  pe.finish();
+
+  double ret = 0.0;
+  for (auto it : partial) ret += it;
+  return ret;
+}
+
 
 /*
   hasNaN returns true if there's a NaN somewhere.
@@ -242,22 +425,72 @@ bool hasNaN(shared_ptr< T > const &a)
 }
 
 
-template<typename T>
-bool hasNaN(map< string, T > const &a)
+/*
+  NaN tests on the bits, since -ffast-math lets the compiler assume there are no NaNs and fold
+  both x != x and std::isnan(x) to false. A NaN has all exponent bits set and a nonzero mantissa.
+*/
+static inline bool hasNaNBits(double a)
 {
-  bool out = false;
-  for (auto &it: a) {
-    out = out || hasNaN(it.second);
+  U64 u;
+  memcpy(&u, &a, sizeof(u));
+  return (u & 0x7fffffffffffffffULL) > 0x7ff0000000000000ULL;
+}
+static inline bool hasNaNBits(float a)
+{
+  U32 u;
+  memcpy(&u, &a, sizeof(u));
+  return (u & 0x7fffffffU) > 0x7f800000U;
+}
+
+/*
+  Scan contiguous data in blocks. Within a block there are no branches, so it vectorizes;
+  between blocks, stop as soon as something turns up.
+*/
+template<typename T>
+bool hasNaNKernel(T const *p, size_t n)
+{
+  size_t const BLOCK = 64;
+  size_t i = 0;
+  for (; i + BLOCK <= n; i += BLOCK) {
+    int any = 0;
+    for (size_t j = 0; j < BLOCK; j++) {
+      any |= (int)hasNaNBits(p[i+j]);
+    }
+    if (any) return true;
   }
-  return out;
+  for (; i < n; i++) {
+    if (hasNaNBits(p[i])) return true;
+  }
+  return false;
+}
+
+static inline bool hasNaN(vector< double > const &a)
+{
+  return hasNaNKernel(a.data(), a.size());
+}
+static inline bool hasNaN(vector< float > const &a)
+{
+  return hasNaNKernel(a.data(), a.size());
 }
 
+template<typename T> bool hasNaN(vector< T > const &a);
+template<typename T> bool hasNaN(map< string, T > const &a);
+
 template<typename T>
 bool hasNaN(vector< T > const &a)
 {
-  bool out = false;
   for (size_t i = 0; i < a.size(); i++) {
-    out = out || hasNaN(a[i]);
+    if (hasNaN(a[i])) return true;
   }
-  return out;
+  return false;
 }
+
+template<typename T>
+bool hasNaN(map< string, T > const &a)
+{
+  for (auto &it: a) {
+    if (hasNaN(it.second)) return true;
+  }
+  return false;
+}
+
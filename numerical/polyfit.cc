@@ -1,5 +1,7 @@
 #include "tlbcore/common/std_headers.h"
 #include "./polyfit.h"
+#include "./polyfit_batch.h"
+#include "./polyfit_accum.h"
 
 /* ----------------------------------------------------------------------
    Evaluate polynomials
@@ -33,77 +35,210 @@ double getDerivative(Polyfit5 const &u, double t)
 }
 
 
+/* ----------------------------------------------------------------------
+   Evaluate polynomials over many points.
+
+   c[0..DEG] are the coefficients, lowest order first. Horner's rule for the derivative runs
+   one step behind the value, so both come out of the same loop. DEG is a template parameter
+   so the inner loop unrolls completely and the outer one vectorizes.
+*/
+
+template<int DEG>
+static void polyEval(double const *c, double const * __restrict t, double * __restrict value, double * __restrict deriv, size_t n)
+{
+  double cr[DEG+1];
+  for (int k = 0; k <= DEG; k++) cr[k] = c[k];
+
+  if (value && deriv) {
+    for (size_t i = 0; i < n; i++) {
+      double x = t[i];
+      double v = cr[DEG];
+      double d = 0.0;
+      for (int k = DEG-1; k >= 0; k--) {
+        d = d * x + v;
+        v = v * x + cr[k];
+      }
+      value[i] = v;
+      deriv[i] = d;
+    }
+  }
+  else if (value) {
+    for (size_t i = 0; i < n; i++) {
+      double x = t[i];
+      double v = cr[DEG];
+      for (int k = DEG-1; k >= 0; k--) {
+        v = v * x + cr[k];
+      }
+      value[i] = v;
+    }
+  }
+  else if (deriv) {
+    for (size_t i = 0; i < n; i++) {
+      double x = t[i];
+      double d = DEG * cr[DEG];
+      for (int k = DEG-1; k >= 1; k--) {
+        d = d * x + k * cr[k];
+      }
+      deriv[i] = d;
+    }
+  }
+}
 
 /*
-  Fit a polynomial to some X and Y data. That is, return a Polyfit{1,3,5} p so that getValue(p, X) approximates Y.
- */
+  Same, but with a different polynomial for each point. c is column-major nFits x (DEG+1),
+  so c[k*n + i] is coefficient k of fit i.
+*/
+template<int DEG>
+static void polyEvalSoA(double const * __restrict c, double const * __restrict t, double * __restrict value, double * __restrict deriv, size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    double x = t[i];
+    double v = c[DEG*n + i];
+    double d = 0.0;
+    for (int k = DEG-1; k >= 0; k--) {
+      d = d * x + v;
+      v = v * x + c[k*n + i];
+    }
+    if (value) value[i] = v;
+    if (deriv) deriv[i] = d;
+  }
+}
 
-Polyfit1 mkPolyfit1(arma::Col< double > xs, arma::Col< double > ys)
+void getValueAndDerivative(Polyfit1 const &u, double const *t, double *value, double *deriv, size_t n)
 {
-  if (xs.n_elem != ys.n_elem) throw runtime_error("incompatible arrays");
-  if (xs.n_elem < 2) throw runtime_error ("not enough data");
+  double c[2] = {u.c0, u.c1};
+  polyEval<1>(c, t, value, deriv, n);
+}
+
+void getValueAndDerivative(Polyfit3 const &u, double const *t, double *value, double *deriv, size_t n)
+{
+  double c[4] = {u.c0, u.c1, u.c2, u.c3};
+  polyEval<3>(c, t, value, deriv, n);
+}
 
-  arma::mat xsm = arma::mat(xs.n_elem, 2);
-  arma::mat ysm = arma::mat(ys.n_elem, 1);
+void getValueAndDerivative(Polyfit5 const &u, double const *t, double *value, double *deriv, size_t n)
+{
+  double c[6] = {u.c0, u.c1, u.c2, u.c3, u.c4, u.c5};
+  polyEval<5>(c, t, value, deriv, n);
+}
 
-  for (size_t ri=0; ri<xs.n_elem; ri++) {
-    double x = xs(ri);
-    double y = ys(ri);
-    xsm(ri, 0) = 1;
-    xsm(ri, 1) = x;
-    ysm(ri, 0) = y;
+void getValueAndDerivative(arma::mat const &coeffs, double const *t, double *value, double *deriv)
+{
+  size_t n = coeffs.n_rows;
+  switch (coeffs.n_cols) {
+    case 2: polyEvalSoA<1>(coeffs.memptr(), t, value, deriv, n); break;
+    case 4: polyEvalSoA<3>(coeffs.memptr(), t, value, deriv, n); break;
+    case 6: polyEvalSoA<5>(coeffs.memptr(), t, value, deriv, n); break;
+    default: throw runtime_error("getValueAndDerivative: coeffs must have 2, 4 or 6 columns");
   }
+}
 
-  // Throws runtime_error if no solution
-  arma::mat coeffs = arma::solve(xsm, ysm);
-  return Polyfit1(coeffs(0,0), coeffs(1,0));
+arma::mat polyfitCoeffs(vector< Polyfit1 > const &fits)
+{
+  arma::mat ret(fits.size(), 2);
+  for (size_t i = 0; i < fits.size(); i++) {
+    ret(i, 0) = fits[i].c0;
+    ret(i, 1) = fits[i].c1;
+  }
+  return ret;
 }
 
+arma::mat polyfitCoeffs(vector< Polyfit3 > const &fits)
+{
+  arma::mat ret(fits.size(), 4);
+  for (size_t i = 0; i < fits.size(); i++) {
+    ret(i, 0) = fits[i].c0;
+    ret(i, 1) = fits[i].c1;
+    ret(i, 2) = fits[i].c2;
+    ret(i, 3) = fits[i].c3;
+  }
+  return ret;
+}
 
-Polyfit3 mkPolyfit3(arma::Col< double > xs, arma::Col< double > ys)
+arma::mat polyfitCoeffs(vector< Polyfit5 > const &fits)
 {
-  if (xs.n_elem != ys.n_elem) throw runtime_error("incompatible arrays");
-  if (xs.n_elem < 4) throw runtime_error ("not enough data");
-
-  arma::mat xsm = arma::mat(xs.n_elem, 4);
-  arma::mat ysm = arma::mat(ys.n_elem, 1);
-
-  for (size_t ri=0; ri<xs.n_elem; ri++) {
-    double x = xs(ri);
-    double y = ys(ri);
-    xsm(ri, 0) = 1;
-    xsm(ri, 1) = x;
-    xsm(ri, 2) = x*x;
-    xsm(ri, 3) = x*x*x;
-    ysm(ri, 0) = y;
+  arma::mat ret(fits.size(), 6);
+  for (size_t i = 0; i < fits.size(); i++) {
+    ret(i, 0) = fits[i].c0;
+    ret(i, 1) = fits[i].c1;
+    ret(i, 2) = fits[i].c2;
+    ret(i, 3) = fits[i].c3;
+    ret(i, 4) = fits[i].c4;
+    ret(i, 5) = fits[i].c5;
   }
+  return ret;
+}
 
-  // Throws runtime_error if no solution
-  arma::mat coeffs = arma::solve(xsm, ysm);
-  return Polyfit3(coeffs(0,0), coeffs(1,0), coeffs(2,0), coeffs(3,0));
+arma::vec getValue(Polyfit1 const &u, arma::vec const &t)
+{
+  arma::vec ret(t.n_elem);
+  getValueAndDerivative(u, t.memptr(), ret.memptr(), nullptr, t.n_elem);
+  return ret;
+}
+arma::vec getDerivative(Polyfit1 const &u, arma::vec const &t)
+{
+  arma::vec ret(t.n_elem);
+  getValueAndDerivative(u, t.memptr(), nullptr, ret.memptr(), t.n_elem);
+  return ret;
+}
+
+arma::vec getValue(Polyfit3 const &u, arma::vec const &t)
+{
+  arma::vec ret(t.n_elem);
+  getValueAndDerivative(u, t.memptr(), ret.memptr(), nullptr, t.n_elem);
+  return ret;
+}
+arma::vec getDerivative(Polyfit3 const &u, arma::vec const &t)
+{
+  arma::vec ret(t.n_elem);
+  getValueAndDerivative(u, t.memptr(), nullptr, ret.memptr(), t.n_elem);
+  return ret;
 }
 
-Polyfit5 mkPolyfit5(arma::Col< double > xs, arma::Col< double > ys)
+arma::vec getValue(Polyfit5 const &u, arma::vec const &t)
+{
+  arma::vec ret(t.n_elem);
+  getValueAndDerivative(u, t.memptr(), ret.memptr(), nullptr, t.n_elem);
+  return ret;
+}
+arma::vec getDerivative(Polyfit5 const &u, arma::vec const &t)
+{
+  arma::vec ret(t.n_elem);
+  getValueAndDerivative(u, t.memptr(), nullptr, ret.memptr(), t.n_elem);
+  return ret;
+}
+
+
+
+/*
+  Fit a polynomial to some X and Y data. That is, return a Polyfit{1,3,5} p so that getValue(p, X) approximates Y.
+  Uses PolyfitAccum, scaled to the range of X, so it doesn't need an n x k matrix.
+ */
+
+static PolyfitAccum mkPolyfitAccum(int degree, arma::Col< double > const &xs, arma::Col< double > const &ys)
 {
   if (xs.n_elem != ys.n_elem) throw runtime_error("incompatible arrays");
-  if (xs.n_elem < 6) throw runtime_error("not enough data");
-
-  arma::mat xsm = arma::mat(xs.n_elem, 6);
-  arma::mat ysm = arma::mat(ys.n_elem, 1);
-
-  for (size_t ri=0; ri<xs.n_elem; ri++) {
-    double x = xs(ri);
-    double y = ys(ri);
-    xsm(ri, 0) = 1;
-    xsm(ri, 1) = x;
-    xsm(ri, 2) = x*x;
-    xsm(ri, 3) = x*x*x;
-    xsm(ri, 4) = x*x*x*x;
-    xsm(ri, 5) = x*x*x*x*x;
-    ysm(ri, 0) = y;
-  }
+  if (xs.n_elem < (size_t)degree + 1) throw runtime_error("not enough data");
+
+  double xMin = xs.min(), xMax = xs.max();
+  double xScale = 0.5 * (xMax - xMin);
+  PolyfitAccum accum(degree, 0.5 * (xMax + xMin), xScale > 0.0 ? xScale : 1.0);
+  accum.add(xs, ys);
+  return accum;
+}
 
+Polyfit1 mkPolyfit1(arma::Col< double > const &xs, arma::Col< double > const &ys)
+{
   // Throws runtime_error if no solution
-  arma::mat coeffs = arma::solve(xsm, ysm);
-  return Polyfit5(coeffs(0,0), coeffs(1,0), coeffs(2,0), coeffs(3,0), coeffs(4,0), coeffs(5,0));
+  return mkPolyfitAccum(1, xs, ys).fit1();
+}
+
+Polyfit3 mkPolyfit3(arma::Col< double > const &xs, arma::Col< double > const &ys)
+{
+  return mkPolyfitAccum(3, xs, ys).fit3();
+}
+
+Polyfit5 mkPolyfit5(arma::Col< double > const &xs, arma::Col< double > const &ys)
+{
+  return mkPolyfitAccum(5, xs, ys).fit5();
 }
@@ -16,6 +16,15 @@ double getDerivative(Polyfit3 const &u, double t);
 double getValue(Polyfit5 const &u, double t);
 double getDerivative(Polyfit5 const &u, double t);
 
-Polyfit1 mkPolyfit1(arma::Col< double > xs, arma::Col< double > ys);
-Polyfit3 mkPolyfit3(arma::Col< double > xs, arma::Col< double > ys);
-Polyfit5 mkPolyfit5(arma::Col< double > xs, arma::Col< double > ys);
+arma::vec getValue(Polyfit1 const &u, arma::vec const &t);
+arma::vec getDerivative(Polyfit1 const &u, arma::vec const &t);
+
+arma::vec getValue(Polyfit3 const &u, arma::vec const &t);
+arma::vec getDerivative(Polyfit3 const &u, arma::vec const &t);
+
+arma::vec getValue(Polyfit5 const &u, arma::vec const &t);
+arma::vec getDerivative(Polyfit5 const &u, arma::vec const &t);
+
+Polyfit1 mkPolyfit1(arma::Col< double > const &xs, arma::Col< double > const &ys);
+Polyfit3 mkPolyfit3(arma::Col< double > const &xs, arma::Col< double > const &ys);
+Polyfit5 mkPolyfit5(arma::Col< double > const &xs, arma::Col< double > const &ys);
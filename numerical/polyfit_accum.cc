@@ -0,0 +1,188 @@
+#include "tlbcore/common/std_headers.h"
+#include "./polyfit_accum.h"
+
+
+PolyfitAccum::PolyfitAccum(int _degree, double _xCenter, double _xScale)
+  :degree(_degree),
+   xCenter(_xCenter),
+   xScale(_xScale)
+{
+  if (degree < 0 || degree > 5) throw runtime_error("PolyfitAccum: degree must be 0..5");
+  if (!(xScale > 0.0)) throw runtime_error("PolyfitAccum: xScale must be positive");
+  clear();
+}
+
+void PolyfitAccum::clear()
+{
+  nSamples = 0;
+  for (auto &it : xMoments) it = 0.0;
+  for (auto &it : yMoments) it = 0.0;
+}
+
+void PolyfitAccum::add(double x, double y, double weight)
+{
+  double u = (x - xCenter) / xScale;
+  double p = weight;
+  for (int j = 0; j <= 2*degree; j++) {
+    xMoments[j] += p;
+    if (j <= degree) yMoments[j] += p * y;
+    p *= u;
+  }
+  nSamples++;
+}
+
+void PolyfitAccum::remove(double x, double y, double weight)
+{
+  if (nSamples == 0) throw runtime_error("PolyfitAccum::remove: empty");
+  double u = (x - xCenter) / xScale;
+  double p = weight;
+  for (int j = 0; j <= 2*degree; j++) {
+    xMoments[j] -= p;
+    if (j <= degree) yMoments[j] -= p * y;
+    p *= u;
+  }
+  nSamples--;
+}
+
+/*
+  Bulk accumulation. DEG is a template parameter so the power loops unroll and the sums stay
+  in registers.
+*/
+template<int DEG>
+static void polyAccum(double const *xs, double const *ys, size_t n, double xCenter, double xScale, double *xMoments, double *yMoments)
+{
+  double xm[2*DEG+1] {}, ym[DEG+1] {};
+  double invScale = 1.0 / xScale;
+  for (size_t i = 0; i < n; i++) {
+    double u = (xs[i] - xCenter) * invScale;
+    double y = ys[i];
+    double p = 1.0;
+    for (int j = 0; j <= 2*DEG; j++) {
+      xm[j] += p;
+      if (j <= DEG) ym[j] += p * y;
+      p *= u;
+    }
+  }
+  for (int j = 0; j <= 2*DEG; j++) xMoments[j] += xm[j];
+  for (int j = 0; j <= DEG; j++) yMoments[j] += ym[j];
+}
+
+void PolyfitAccum::add(double const *xs, double const *ys, size_t n)
+{
+  switch (degree) {
+    case 0: polyAccum<0>(xs, ys, n, xCenter, xScale, xMoments, yMoments); break;
+    case 1: polyAccum<1>(xs, ys, n, xCenter, xScale, xMoments, yMoments); break;
+    case 2: polyAccum<2>(xs, ys, n, xCenter, xScale, xMoments, yMoments); break;
+    case 3: polyAccum<3>(xs, ys, n, xCenter, xScale, xMoments, yMoments); break;
+    case 4: polyAccum<4>(xs, ys, n, xCenter, xScale, xMoments, yMoments); break;
+    case 5: polyAccum<5>(xs, ys, n, xCenter, xScale, xMoments, yMoments); break;
+  }
+  nSamples += n;
+}
+
+void PolyfitAccum::add(arma::vec const &xs, arma::vec const &ys)
+{
+  if (xs.n_elem != ys.n_elem) throw runtime_error("incompatible arrays");
+  add(xs.memptr(), ys.memptr(), xs.n_elem);
+}
+
+/*
+  Split the data into chunks, accumulate each on its own thread and merge the results.
+  Merging happens in chunk order, so the result doesn't depend on thread scheduling.
+  The chunk threads take their slots from pe, but we wait only for them, not for anything
+  else running on pe.
+*/
+void PolyfitAccum::addParallel(double const *xs, double const *ys, size_t n, ParEngine &pe, size_t chunkSize)
+{
+  if (chunkSize == 0) chunkSize = n;
+  size_t nChunks = (n + chunkSize - 1) / chunkSize;
+  if (nChunks <= 1) {
+    add(xs, ys, n);
+    return;
+  }
+
+  vector< PolyfitAccum > parts(nChunks, PolyfitAccum(degree, xCenter, xScale));
+  ParEngine chunks; // Only for joining
+  for (size_t ci = 0; ci < nChunks; ci++) {
+    size_t lo = ci * chunkSize;
+    size_t hi = min(n, lo + chunkSize);
+    PolyfitAccum *part = &parts[ci];
+    chunks.push(thread([part, xs, ys, lo, hi, &pe]() {
+      ParEngineRsv rsv(&pe, 0);
+      part->add(xs + lo, ys + lo, hi - lo);
+    }));
+  }
+  chunks.finish();
+
+  for (auto &it : parts) merge(it);
+}
+
+void PolyfitAccum::merge(PolyfitAccum const &other)
+{
+  if (other.degree != degree || other.xCenter != xCenter || other.xScale != xScale) {
+    throw runtime_error("PolyfitAccum::merge: incompatible accumulators");
+  }
+  for (int j = 0; j <= 2*degree; j++) xMoments[j] += other.xMoments[j];
+  for (int j = 0; j <= degree; j++) yMoments[j] += other.yMoments[j];
+  nSamples += other.nSamples;
+}
+
+/*
+  Solve the normal equations for coefficients a in u, then expand
+    sum_j a_j ((x - c)/s)^j
+  into powers of x.
+*/
+arma::vec PolyfitAccum::solve() const
+{
+  size_t k = (size_t)degree + 1;
+  if (nSamples < k) throw runtime_error("not enough data");
+
+  arma::mat nm(k, k);
+  arma::mat rhs(k, 1);
+  for (size_t i = 0; i < k; i++) {
+    for (size_t j = 0; j < k; j++) {
+      nm(i, j) = xMoments[i + j];
+    }
+    rhs(i, 0) = yMoments[i];
+  }
+
+  // Throws runtime_error if no solution
+  arma::mat a = arma::solve(nm, rhs);
+
+  arma::vec ret(k);
+  for (size_t m = 0; m < k; m++) {
+    double binom = 1.0; // C(j, m), starting at j = m
+    double negCPow = 1.0; // (-c)^(j-m)
+    double invSPow = pow(xScale, -(double)m); // s^-j
+    double sum = 0.0;
+    for (size_t j = m; j < k; j++) {
+      sum += a(j, 0) * invSPow * binom * negCPow;
+      binom = binom * (double)(j + 1) / (double)(j + 1 - m);
+      negCPow *= -xCenter;
+      invSPow /= xScale;
+    }
+    ret(m) = sum;
+  }
+  return ret;
+}
+
+Polyfit1 PolyfitAccum::fit1() const
+{
+  if (degree != 1) throw runtime_error("PolyfitAccum::fit1: wrong degree");
+  arma::vec c = solve();
+  return Polyfit1(c(0), c(1));
+}
+
+Polyfit3 PolyfitAccum::fit3() const
+{
+  if (degree != 3) throw runtime_error("PolyfitAccum::fit3: wrong degree");
+  arma::vec c = solve();
+  return Polyfit3(c(0), c(1), c(2), c(3));
+}
+
+Polyfit5 PolyfitAccum::fit5() const
+{
+  if (degree != 5) throw runtime_error("PolyfitAccum::fit5: wrong degree");
+  arma::vec c = solve();
+  return Polyfit5(c(0), c(1), c(2), c(3), c(4), c(5));
+}
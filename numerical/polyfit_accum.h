@@ -0,0 +1,48 @@
+#pragma once
+#include "./polyfit.h"
+#include "../common/parengine.h"
+
+/*
+  Incremental least-squares polynomial fitting.
+
+  Instead of building the n x (degree+1) Vandermonde matrix, keep running sums of w*u^j
+  (j = 0 .. 2*degree) and w*y*u^j (j = 0 .. degree), which are all the normal equations need.
+  Memory is O(degree) no matter how much data goes in.
+
+  Since everything is a plain sum:
+    - merge() adds another accumulator, so chunks can be accumulated on separate threads
+      and combined (see addParallel)
+    - remove() subtracts a sample, for sliding-window refitting. Rounding error builds up
+      over very long runs of add/remove, so refill from scratch once in a while.
+
+  The normal equations square the condition number, so x is mapped to u = (x - xCenter) / xScale
+  before accumulating. Choose these so that u stays within about [-1, 1] over your data, and
+  the fit will be nearly as accurate as a QR solve. fit*() returns coefficients in terms of
+  the original x.
+*/
+
+struct PolyfitAccum {
+  explicit PolyfitAccum(int _degree, double _xCenter = 0.0, double _xScale = 1.0);
+
+  void clear();
+  void add(double x, double y, double weight = 1.0);
+  void add(double const *xs, double const *ys, size_t n);
+  void add(arma::vec const &xs, arma::vec const &ys);
+  void addParallel(double const *xs, double const *ys, size_t n, ParEngine &pe, size_t chunkSize = 1000000);
+  void remove(double x, double y, double weight = 1.0);
+  void merge(PolyfitAccum const &other);
+
+  // Coefficients in x, lowest order first. Throws runtime_error if there's no solution.
+  arma::vec solve() const;
+
+  Polyfit1 fit1() const;
+  Polyfit3 fit3() const;
+  Polyfit5 fit5() const;
+
+  int degree;
+  double xCenter;
+  double xScale;
+  size_t nSamples {0};
+  double xMoments[11];
+  double yMoments[6];
+};
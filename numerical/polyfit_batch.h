@@ -0,0 +1,27 @@
+#pragma once
+#include "./polyfit.h"
+
+/*
+  Evaluate polynomial fits over many points at once. Kept out of polyfit.h because code_gen
+  doesn't understand raw pointers.
+
+  The kernels use Horner's method, computing the value and derivative in the same pass. The
+  loops are simple enough that the compiler vectorizes them across t, and with -mfma (or
+  -march=native) each Horner step becomes a fused multiply-add.
+  value or deriv may be nullptr if you don't want them.
+*/
+
+void getValueAndDerivative(Polyfit1 const &u, double const *t, double *value, double *deriv, size_t n);
+void getValueAndDerivative(Polyfit3 const &u, double const *t, double *value, double *deriv, size_t n);
+void getValueAndDerivative(Polyfit5 const &u, double const *t, double *value, double *deriv, size_t n);
+
+/*
+  Many fits at once, in structure-of-arrays layout: coeffs is nFits x (degree+1), so column k
+  holds c_k of every fit contiguously. Fit i is evaluated at t[i].
+  Use polyfitCoeffs to pack a vector of fits this way.
+*/
+void getValueAndDerivative(arma::mat const &coeffs, double const *t, double *value, double *deriv);
+
+arma::mat polyfitCoeffs(vector< Polyfit1 > const &fits);
+arma::mat polyfitCoeffs(vector< Polyfit3 > const &fits);
+arma::mat polyfitCoeffs(vector< Polyfit5 > const &fits);
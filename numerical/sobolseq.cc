@@ -0,0 +1,175 @@
+#include "tlbcore/common/std_headers.h"
+#include "./sobolseq.h"
+#include "./haltonseq.h"
+
+static inline U32 reverseBits(U32 x)
+{
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+/*
+  Burley's hash. Every step only carries information from lower bits to higher ones, so
+  applied to bit-reversed x, each output bit depends only on the bits above it in x. That's
+  the defining property of a nested uniform scramble.
+*/
+static inline U32 owenScramble(U32 x, U32 seed)
+{
+  x = reverseBits(x);
+  x ^= x * 0x3d20adeau;
+  x += seed;
+  x *= (seed >> 16) | 1;
+  x ^= x * 0x05526c56u;
+  x ^= x * 0x53a22864u;
+  return reverseBits(x);
+}
+
+static inline U32 hashAxisSeed(U32 seed, U32 axis)
+{
+  U64 z = ((U64)seed << 32 | axis) + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return (U32)(z ^ (z >> 31));
+}
+
+
+SobolGenerator::SobolGenerator(size_t _nCols, U32 _scrambleSeed, u_int _index)
+  :nCols(_nCols),
+   scrambleSeed(_scrambleSeed)
+{
+  if (nCols > SOBOL_MAX_DIMS) throw runtime_error("SobolGenerator: too many columns");
+  directions.resize(nCols * SOBOL_BITS);
+  axisSeeds.resize(nCols);
+  state.resize(nCols);
+
+  for (size_t ci = 0; ci < nCols; ci++) {
+    U32 *v = &directions[ci * SOBOL_BITS];
+    if (ci == 0) {
+      for (size_t k = 0; k < SOBOL_BITS; k++) {
+        v[k] = 1u << (SOBOL_BITS - 1 - k);
+      }
+    } else {
+      auto &init = sobolDirectionInits[ci - 1];
+      size_t s = init.s;
+      for (size_t k = 0; k < min(s, SOBOL_BITS); k++) {
+        v[k] = init.m[k] << (SOBOL_BITS - 1 - k);
+      }
+      for (size_t k = s; k < SOBOL_BITS; k++) {
+        U32 vk = v[k - s] ^ (v[k - s] >> s);
+        for (size_t i = 1; i < s; i++) {
+          if ((init.a >> (s - 1 - i)) & 1) vk ^= v[k - i];
+        }
+        v[k] = vk;
+      }
+    }
+    axisSeeds[ci] = scrambleSeed ? hashAxisSeed(scrambleSeed, (U32)ci) : 0;
+  }
+  seek(_index);
+}
+
+/*
+  Point i in Gray-code order is the XOR of the direction numbers selected by the bits of i ^ (i>>1)
+*/
+void SobolGenerator::seek(u_int _index)
+{
+  index = _index;
+  U32 gray = index ^ (index >> 1);
+  for (size_t ci = 0; ci < nCols; ci++) {
+    U32 const *v = &directions[ci * SOBOL_BITS];
+    U32 x = 0;
+    for (size_t k = 0; k < SOBOL_BITS; k++) {
+      if (gray & (1u << k)) x ^= v[k];
+    }
+    state[ci] = x;
+  }
+}
+
+/*
+  Fill rows [rowLo, rowHi) of out with the next points, one axis (column) at a time.
+*/
+void SobolGenerator::fillRows(arma::mat &out, size_t rowLo, size_t rowHi)
+{
+  if (out.n_cols != nCols) throw runtime_error("SobolGenerator: wrong number of columns");
+  if (rowHi > out.n_rows || rowLo > rowHi) throw runtime_error("SobolGenerator: bad row range");
+  size_t n = rowHi - rowLo;
+  if ((U64)index + n > 0xffffffffULL) throw runtime_error("SobolGenerator: index overflow");
+
+  double const scale = 1.0 / 4294967296.0;
+  for (size_t ci = 0; ci < nCols; ci++) {
+    U32 const *v = &directions[ci * SOBOL_BITS];
+    U32 x = state[ci];
+    U32 seed = axisSeeds[ci];
+    double *col = out.colptr(ci) + rowLo;
+    u_int i = index;
+    if (scrambleSeed) {
+      for (size_t ri = 0; ri < n; ri++) {
+        col[ri] = owenScramble(x, seed) * scale;
+        x ^= v[__builtin_ctz(++i)];
+      }
+    } else {
+      for (size_t ri = 0; ri < n; ri++) {
+        col[ri] = x * scale;
+        x ^= v[__builtin_ctz(++i)];
+      }
+    }
+    state[ci] = x;
+  }
+  index += (u_int)n;
+}
+
+void SobolGenerator::fill(arma::mat &out)
+{
+  fillRows(out, 0, out.n_rows);
+}
+
+void SobolGenerator::next(arma::vec &out)
+{
+  arma::mat tmp(1, nCols);
+  fillRows(tmp, 0, 1);
+  out.set_size(nCols);
+  for (size_t ci = 0; ci < nCols; ci++) {
+    out[ci] = tmp(0, ci);
+  }
+}
+
+/*
+  Like fill, but split into chunks of rows generated on separate threads. Gives the same
+  result as fill.
+  pe's limits apply, as in HaltonGenerator::fillParallel.
+*/
+void SobolGenerator::fillParallel(arma::mat &out, ParEngine &pe, size_t chunkRows)
+{
+  if (out.n_cols != nCols) throw runtime_error("SobolGenerator: wrong number of columns");
+  if (chunkRows == 0) chunkRows = out.n_rows;
+  u_int startIndex = index;
+  ParEngine chunks;
+  for (size_t rowLo = 0; rowLo < out.n_rows; rowLo += chunkRows) {
+    size_t rowHi = min((size_t)out.n_rows, rowLo + chunkRows);
+    arma::mat *outp = &out;
+    SobolGenerator const *proto = this;
+    chunks.push(thread([outp, proto, startIndex, rowLo, rowHi, &pe]() {
+      ParEngineRsv rsv(&pe, 0);
+      SobolGenerator gen(*proto);
+      gen.seek(startIndex + (u_int)rowLo);
+      gen.fillRows(*outp, rowLo, rowHi);
+    }));
+  }
+  chunks.finish();
+  seek(startIndex + (u_int)out.n_rows);
+}
+
+
+/*
+  Skip point 0, which is all zeros unless scrambled, to stay clear of log(0).
+*/
+void gaussianSobolBlock(arma::mat &out, u_int startIndex, U32 scrambleSeed)
+{
+  size_t nUniform = (out.n_cols + 1) & ~(size_t)1;
+  SobolGenerator gen(nUniform, scrambleSeed, startIndex + 1);
+  arma::mat uniform(out.n_rows, nUniform);
+  gen.fill(uniform);
+  boxMullerBlock(uniform, out);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "./numerical.h"
+#include "../common/parengine.h"
+
+/*
+  Generate Sobol sequences, for when Halton's 45 axes aren't enough or its higher axes
+  correlate too much. Uses Joe & Kuo's direction numbers, which go up to 1024 axes here.
+  See https://web.maths.unsw.edu.au/~fkuo/sobol/
+
+  Like HaltonGenerator, points go one per row into a preallocated matrix. They're generated in
+  Gray-code order (Antonov & Saleev), so a point costs one XOR per axis.
+
+  With a nonzero scrambleSeed, each axis gets a nested uniform (Owen) scramble, approximated with
+  the hash from Burley, "Practical Hash-based Owen Scrambling", JCGT 9(4), 2020. This keeps the
+  stratification but breaks up the patterns in 2D projections, and different seeds give
+  independent randomizations, so you can estimate error by comparing them.
+*/
+
+static const size_t SOBOL_MAX_DIMS = 1024;
+static const size_t SOBOL_BITS = 32;
+
+struct SobolDirectionInit {
+  u_int s;
+  u_int a;
+  u_int m[13];
+};
+extern SobolDirectionInit const sobolDirectionInits[SOBOL_MAX_DIMS - 1];
+
+struct SobolGenerator {
+  explicit SobolGenerator(size_t _nCols, U32 _scrambleSeed = 0, u_int _index = 0);
+
+  void seek(u_int _index);
+  void next(arma::vec &out);
+  void fill(arma::mat &out);
+  void fillRows(arma::mat &out, size_t rowLo, size_t rowHi);
+  void fillParallel(arma::mat &out, ParEngine &pe, size_t chunkRows = 65536);
+
+  size_t nCols;
+  U32 scrambleSeed;
+  u_int index;
+  vector< U32 > directions; // SOBOL_BITS per axis
+  vector< U32 > axisSeeds;
+  vector< U32 > state; // Current point of each axis, before scrambling
+};
+
+/*
+  Normally distributed points from a Sobol sequence, like gaussianHaltonBlock.
+*/
+void gaussianSobolBlock(arma::mat &out, u_int startIndex, U32 scrambleSeed = 0);
@@ -0,0 +1,22 @@
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const haltonseq = require('./haltonseq');
+
+describe('haltonseq', function() {
+  it('should give gaussian rows up to the maximum column count', function() {
+    _.each([45, 46], (nCols) => {
+      let row = haltonseq.gaussianHaltonRow(7, nCols);
+      assert.equal(row.length, nCols);
+      _.each(row, (x) => assert.ok(isFinite(x)));
+    });
+    assert.throws(() => haltonseq.gaussianHaltonRow(7, 47), /nCols too large/);
+  });
+
+  it('should give unipolar rows in [0..1]', function() {
+    let row = haltonseq.unipolarHaltonRow(12345, 46);
+    assert.equal(row.length, 46);
+    _.each(row, (x) => assert.ok(x >= 0 && x < 1));
+    assert.throws(() => haltonseq.unipolarHaltonRow(1, 47), /nCols too large/);
+  });
+});
@@ -43,3 +43,110 @@ std::function< double(double t) > getNamedWindow(string const &type)
 
   throw runtime_error("No such window");
 }
+
+
+/* ----------------------------------------------------------------------
+   Window tables.
+
+   Sample i of an n-point table is the window at t = i/(n-1), so both ends are included.
+   (A 1-point table is the window at 0.5.) All the windows are symmetric about t=0.5,
+   so only the first half is computed and the rest mirrored.
+*/
+
+static void fillNuttallTable(double *w, size_t n)
+{
+  size_t half = (n + 1) / 2;
+  double dt = 1.0 / (double)(n - 1);
+  for (size_t i = 0; i < half; i++) {
+    // cos(4x) and cos(6x) from cos(2x) by the Chebyshev recurrence, saving two cos calls
+    double c2 = cos(2.0 * M_PI * (double)i * dt);
+    double c4 = 2.0 * c2 * c2 - 1.0;
+    double c6 = 2.0 * c2 * c4 - c2;
+    w[i] = 0.355768 - 0.487396 * c2 + 0.144232 * c4 - 0.012604 * c6;
+  }
+}
+
+static void fillTukeyTable(double *w, size_t n, double a)
+{
+  size_t half = (n + 1) / 2;
+  double dt = 1.0 / (double)(n - 1);
+  for (size_t i = 0; i < half; i++) {
+    double t = (double)i * dt;
+    w[i] = (t < 0.5*a) ? 0.5 * (1 + cos(M_PI * (2.0 * t / a - 1.0))) : 1.0;
+  }
+}
+
+static void fillLanczosTable(double *w, size_t n)
+{
+  size_t half = (n + 1) / 2;
+  double dt = 1.0 / (double)(n - 1);
+  for (size_t i = 0; i < half; i++) {
+    double tp = 2.0 * M_PI * ((double)i * dt - 0.5);
+    w[i] = (tp < 1.0e-6 && tp > -1.0e-6) ? 1.0 : sin(tp)/tp;
+  }
+}
+
+void fillNamedWindow(string const &type, arma::vec &out)
+{
+  size_t n = out.n_elem;
+  if (n == 0) return;
+  double *w = out.memptr();
+  if (n == 1) {
+    w[0] = getNamedWindow(type)(0.5);
+    return;
+  }
+
+  if (type == "nuttall") {
+    fillNuttallTable(w, n);
+  }
+  else if (type == "tukey0.5") {
+    fillTukeyTable(w, n, 0.5);
+  }
+  else if (type == "lanczos") {
+    fillLanczosTable(w, n);
+  }
+  else if (type == "rectangular") {
+    out.fill(1.0);
+    return;
+  }
+  else {
+    throw runtime_error("No such window");
+  }
+  for (size_t i = (n + 1) / 2; i < n; i++) {
+    w[i] = w[n - 1 - i];
+  }
+}
+
+/*
+  Tables are cached forever by (type, n), on the assumption that a program only uses a few
+  frame sizes. The returned reference stays valid.
+*/
+static mutex namedWindowTablesMutex;
+static map< pair< string, size_t >, arma::vec > namedWindowTables;
+
+arma::vec const &getNamedWindowTable(string const &type, size_t n)
+{
+  lock_guard< mutex > lock(namedWindowTablesMutex);
+  auto key = make_pair(type, n);
+  auto slot = namedWindowTables.find(key);
+  if (slot != namedWindowTables.end()) return slot->second;
+
+  arma::vec table(n);
+  fillNamedWindow(type, table);
+  return namedWindowTables.emplace(key, std::move(table)).first->second;
+}
+
+/*
+  out = in .* window. out may be the same as in.
+*/
+void applyNamedWindow(string const &type, arma::vec const &in, arma::vec &out)
+{
+  size_t n = in.n_elem;
+  double const *w = getNamedWindowTable(type, n).memptr();
+  if (&out != &in) out.set_size(n);
+  double const *ip = in.memptr();
+  double *op = out.memptr();
+  for (size_t i = 0; i < n; i++) {
+    op[i] = ip[i] * w[i];
+  }
+}
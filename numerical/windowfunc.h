@@ -1,4 +1,5 @@
 #pragma once
+#include "./numerical.h"
 
 double nuttallWindow(double t);
 double tukeyWindow(double t, double a);
@@ -6,3 +7,11 @@ double lanczosWindow(double t);
 double rectangularWindow(double t);
 
 std::function< double(double t) > getNamedWindow(string const &type);
+
+/*
+  Whole windows at once, sampled at t = i/(n-1). getNamedWindowTable caches tables by
+  (type, n), so repeated frames of the same size don't recompute them.
+*/
+void fillNamedWindow(string const &type, arma::vec &out);
+arma::vec const &getNamedWindowTable(string const &type, size_t n);
+void applyNamedWindow(string const &type, arma::vec const &in, arma::vec &out);
@@ -0,0 +1,51 @@
+/*
+  Throughput of Halton point generation: unipolarHaltonRow one row at a time, HaltonGenerator
+  filling a block, and the same split across threads. Also SobolGenerator, plain and scrambled.
+
+  Compile and run with (from the directory containing tlbcore):
+  $ g++ -std=c++14 -O3 -march=native -I. -o halton_perf tlbcore/perf/halton_perf.cc tlbcore/numerical/haltonseq.cc tlbcore/numerical/sobolseq.cc tlbcore/numerical/sobol_directions.cc tlbcore/numerical/fastrandom.cc tlbcore/common/parengine.cc tlbcore/common/hacks.cc -larmadillo -lpthread && ./halton_perf
+*/
+#include "tlbcore/common/std_headers.h"
+#include "tlbcore/numerical/haltonseq.h"
+#include "tlbcore/numerical/sobolseq.h"
+
+int main(int argc, char **argv)
+{
+  size_t nRows = 2000000;
+
+  for (size_t nCols : {2, 10, 45}) {
+    arma::mat rowwise(nRows, nCols), block(nRows, nCols), par(nRows, nCols);
+
+    double t0 = realtime();
+    for (size_t ri = 0; ri < nRows; ri++) {
+      rowwise.row(ri) = unipolarHaltonRow((u_int)ri, nCols).t();
+    }
+    double t1 = realtime();
+    HaltonGenerator gen(nCols);
+    gen.fill(block);
+    double t2 = realtime();
+    ParEngine pe;
+    HaltonGenerator pgen(nCols);
+    pgen.fillParallel(par, pe);
+    double t3 = realtime();
+
+    eprintf("cols=%-3zu rows %7.1f Mpts/s  block %7.1f Mpts/s  parallel %7.1f Mpts/s  maxErr=%g\n",
+            nCols, nRows / (t1 - t0) * 1e-6, nRows / (t2 - t1) * 1e-6, nRows / (t3 - t2) * 1e-6,
+            max(arma::abs(rowwise - block).max(), arma::abs(block - par).max()));
+  }
+
+  for (size_t nCols : {10, 100, 1000}) {
+    size_t nSobolRows = 20000000 / nCols;
+    arma::mat plain(nSobolRows, nCols), scrambled(nSobolRows, nCols);
+    double t0 = realtime();
+    SobolGenerator gen(nCols);
+    gen.fill(plain);
+    double t1 = realtime();
+    SobolGenerator sgen(nCols, 12345);
+    sgen.fill(scrambled);
+    double t2 = realtime();
+    eprintf("sobol cols=%-4zu plain %7.1f Mvals/s  scrambled %7.1f Mvals/s\n",
+            nCols, plain.n_elem / (t1 - t0) * 1e-6, scrambled.n_elem / (t2 - t1) * 1e-6);
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+/*
+  Throughput of jump_consistent_hash, one key at a time vs batched, and of the rebalancing helper.
+
+  Compile and run with (from the directory containing tlbcore, after building build.src):
+  $ g++ -std=c++14 -O3 -march=native -I. -Itlbcore -o jump_hash_perf tlbcore/perf/jump_hash_perf.cc tlbcore/common/hacks.cc -larmadillo && ./jump_hash_perf
+*/
+#include "tlbcore/common/std_headers.h"
+
+int main(int argc, char **argv)
+{
+  size_t nKeys = 10000000;
+  vector< uint64_t > keys(nKeys);
+  uint64_t x = 0x9e3779b97f4a7c15ULL;
+  for (auto &it : keys) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    it = x;
+  }
+
+  for (int32_t numBuckets : {10, 1000, 100000}) {
+    vector< int32_t > scalarBuckets(nKeys), batchBuckets(nKeys);
+
+    double t0 = realtime();
+    for (size_t i = 0; i < nKeys; i++) {
+      scalarBuckets[i] = jump_consistent_hash(keys[i], numBuckets);
+    }
+    double t1 = realtime();
+    jump_consistent_hash(keys.data(), batchBuckets.data(), nKeys, numBuckets);
+    double t2 = realtime();
+
+    if (scalarBuckets != batchBuckets) {
+      eprintf("Mismatch between scalar and batch results\n");
+      return 1;
+    }
+    eprintf("buckets=%-7d scalar %7.1f Mkeys/s  batch %7.1f Mkeys/s\n",
+            numBuckets, nKeys / (t1 - t0) * 1e-6, nKeys / (t2 - t1) * 1e-6);
+
+    vector< size_t > movedIndexes;
+    vector< int32_t > movedTo;
+    double t3 = realtime();
+    jump_consistent_hash_moves(keys.data(), nKeys, numBuckets, numBuckets + 1, movedIndexes, movedTo);
+    double t4 = realtime();
+    eprintf("  grow to %d: %zu keys moved (expect ~%zu), %.1f Mkeys/s\n",
+            numBuckets + 1, movedIndexes.size(), nKeys / (numBuckets + 1), nKeys / (t4 - t3) * 1e-6);
+  }
+  return 0;
+}
@@ -0,0 +1,55 @@
+/*
+  Throughput of Polyfit5 evaluation, one point at a time vs the batch kernels in polyfit_batch.h,
+  and of evaluating many different fits at once from SoA coefficients.
+
+  Compile and run with (from the directory containing tlbcore, after building build.src):
+  $ g++ -std=c++14 -O3 -march=native -I. -Itlbcore -o polyfit_perf tlbcore/perf/polyfit_perf.cc tlbcore/numerical/polyfit.cc tlbcore/common/hacks.cc -larmadillo && ./polyfit_perf
+*/
+#include "tlbcore/common/std_headers.h"
+#include "tlbcore/numerical/polyfit_batch.h"
+
+int main(int argc, char **argv)
+{
+  size_t n = 10000000;
+  arma::vec t = arma::linspace< arma::vec >(-1.0, 1.0, n);
+  Polyfit5 u(0.5, -1.25, 0.75, 2.0, -0.3, 0.125);
+
+  arma::vec scalarValue(n), scalarDeriv(n), batchValue(n), batchDeriv(n);
+
+  double t0 = realtime();
+  for (size_t i = 0; i < n; i++) {
+    scalarValue[i] = getValue(u, t[i]);
+    scalarDeriv[i] = getDerivative(u, t[i]);
+  }
+  double t1 = realtime();
+  getValueAndDerivative(u, t.memptr(), batchValue.memptr(), batchDeriv.memptr(), n);
+  double t2 = realtime();
+
+  double maxErr = max(arma::abs(scalarValue - batchValue).max(), arma::abs(scalarDeriv - batchDeriv).max());
+  eprintf("single fit: scalar %7.1f Mpts/s  batch %7.1f Mpts/s  maxErr=%g\n",
+          n / (t1 - t0) * 1e-6, n / (t2 - t1) * 1e-6, maxErr);
+
+  size_t nFits = 1000000;
+  vector< Polyfit5 > fits(nFits);
+  for (size_t i = 0; i < nFits; i++) {
+    double a = (double)i / nFits;
+    fits[i] = Polyfit5(a, 1.0 - a, 0.5 * a, -a, 0.25, a * a);
+  }
+  arma::vec ft = arma::linspace< arma::vec >(0.0, 2.0, nFits);
+  arma::vec fitScalarValue(nFits), fitBatchValue(nFits), fitBatchDeriv(nFits);
+
+  double t3 = realtime();
+  for (size_t i = 0; i < nFits; i++) {
+    fitScalarValue[i] = getValue(fits[i], ft[i]);
+  }
+  double t4 = realtime();
+  arma::mat coeffs = polyfitCoeffs(fits);
+  double t5 = realtime();
+  getValueAndDerivative(coeffs, ft.memptr(), fitBatchValue.memptr(), fitBatchDeriv.memptr());
+  double t6 = realtime();
+
+  eprintf("many fits:  scalar %7.1f Mfits/s  SoA %7.1f Mfits/s (+ %.1f ms to pack)  maxErr=%g\n",
+          nFits / (t4 - t3) * 1e-6, nFits / (t6 - t5) * 1e-6, (t5 - t4) * 1e3,
+          arma::abs(fitScalarValue - fitBatchValue).max());
+  return 0;
+}
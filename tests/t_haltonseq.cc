@@ -0,0 +1,46 @@
+/*
+  Halton rows at the maximum column count, where gaussianHaltonRow uses the last pair of axes,
+  checked against gaussianHaltonBlock.
+
+  Compile and run with (from the directory containing tlbcore, after building build.src):
+  $ g++ -std=c++14 -O2 -I. -Itlbcore -o t_haltonseq tlbcore/tests/t_haltonseq.cc tlbcore/numerical/haltonseq.cc tlbcore/numerical/fastrandom.cc tlbcore/common/parengine.cc tlbcore/common/hacks.cc -larmadillo -lpthread && ./t_haltonseq
+*/
+#include "tlbcore/common/std_headers.h"
+#include "tlbcore/numerical/haltonseq.h"
+
+static int nFail;
+
+static void check(char const *desc, bool ok)
+{
+  printf("%s %s\n", ok ? "ok  " : "FAIL", desc);
+  if (!ok) nFail++;
+}
+
+int main(int argc, char **argv)
+{
+  for (size_t nCols : {45, 46}) {
+    size_t nRows = 100;
+    arma::mat block(nRows, nCols);
+    gaussianHaltonBlock(block, 0);
+    double maxErr = 0.0;
+    for (size_t ri = 0; ri < nRows; ri++) {
+      arma::vec row = gaussianHaltonRow((u_int)ri, nCols);
+      for (size_t ci = 0; ci < nCols; ci++) {
+        maxErr = max(maxErr, fabs(row[ci] - block(ri, ci)));
+      }
+    }
+    check(stringprintf("gaussianHaltonRow with %zu columns matches gaussianHaltonBlock (maxErr=%g)", nCols, maxErr).c_str(),
+          maxErr < 1e-9);
+  }
+
+  bool threw = false;
+  try {
+    gaussianHaltonRow(0, 47);
+  }
+  catch (runtime_error const &ex) {
+    threw = true;
+  }
+  check("gaussianHaltonRow with 47 columns throws", threw);
+
+  return nFail ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+/*
+  JsonFixedCodec built from schemas: canonical input takes the fast path, anything else
+  falls back to the general reader, and a field list that doesn't match the schema throws.
+
+  Compile and run with (from the directory containing tlbcore, after building build.src):
+  $ g++ -std=c++14 -O2 -I. -Itlbcore -o t_jsonio_fixed tlbcore/tests/t_jsonio_fixed.cc tlbcore/common/jsonio_fixed.cc tlbcore/common/jsonio.cc tlbcore/common/jsonio_parse.cc tlbcore/common/jsonio_types.cc tlbcore/common/ndarray_encoding.cc tlbcore/common/compress_parallel.cc tlbcore/common/parengine.cc tlbcore/common/chunk_file.cc tlbcore/common/hacks.cc -larmadillo -lz -lpthread && ./t_jsonio_fixed
+*/
+#include "tlbcore/common/std_headers.h"
+#include "tlbcore/common/jsonio.h"
+#include "tlbcore/numerical/bezier.h"
+
+static int nFail;
+
+static void check(char const *desc, bool ok)
+{
+  printf("%s %s\n", ok ? "ok  " : "FAIL", desc);
+  if (!ok) nFail++;
+}
+
+/*
+  The schema lists b before a, the reverse of the declaration and of the field list below.
+*/
+struct Pair {
+  double a = 0.0;
+  string b;
+};
+
+char const * getSchema(Pair const &)
+{
+  return "{\"typename\":\"Pair\",\"members\":[{\"memberName\":\"b\",\"type\":\"string\"},{\"memberName\":\"a\",\"type\":\"double\"}]}";
+}
+
+static bool eqBezier(CubicBezier< double > const &x, CubicBezier< double > const &y)
+{
+  return x.p0 == y.p0 && x.p1 == y.p1 && x.p2 == y.p2 && x.p3 == y.p3;
+}
+
+/*
+  Check readFast on s, then make sure fromJson (which falls back when readFast doesn't match)
+  reads the same value.
+*/
+static void readBezier(char const *desc, string const &s, bool expectFast, CubicBezier< double > const &expected)
+{
+  CubicBezier< double > b;
+  RdJsonContext ctx(s.c_str(), nullptr, false);
+  ctx.endStr = ctx.s + s.size();
+  bool fast = cubicBezierJsonCodec< double >().readFast(ctx, b);
+  check(stringprintf("%s: readFast %s", desc, expectFast ? "matches" : "declines").c_str(),
+        fast == expectFast && (fast ? *ctx.s == 0 : ctx.s == s.c_str()));
+
+  CubicBezier< double > c;
+  string err;
+  bool ok = fromJson(s, c, err);
+  check(stringprintf("%s: fromJson %s", desc, ok ? "reads it" : err.c_str()).c_str(), ok && eqBezier(c, expected));
+}
+
+int main(int argc, char **argv)
+{
+  CubicBezier< double > a(1, 3.5, -0.25, 8);
+
+  jsonstr js = asJson(a);
+  check(stringprintf("CubicBezier writes keys in schema order: %s", js.it.c_str()).c_str(),
+        js.it == "{\"__type\":\"CubicBezier\",\"p0\":1,\"p1\":3.5,\"p2\":-0.25,\"p3\":8}");
+  readBezier("canonical", js.it, true, a);
+  readBezier("spaces", "{ \"__type\" : \"CubicBezier\", \"p0\" : 1, \"p1\" : 3.5, \"p2\" : -0.25, \"p3\" : 8 }",
+    false, a);
+  readBezier("reordered", "{\"__type\":\"CubicBezier\",\"p3\":8,\"p2\":-0.25,\"p1\":3.5,\"p0\":1}",
+    false, a);
+  readBezier("__type last", "{\"p0\":1,\"p1\":3.5,\"p2\":-0.25,\"p3\":8,\"__type\":\"CubicBezier\"}", false, a);
+
+  map< string, jsonstr > schemas;
+  addSchemas(a, schemas);
+  check("addSchemas registers CubicBezier", schemas.count("CubicBezier") && !schemas["CubicBezier"].isNull());
+
+  // Key order comes from the schema, not the field list
+  auto pairCodec = mkJsonFixedCodecFromSchema< Pair >(
+    jsonFixedField("a", &Pair::a),
+    jsonFixedField("b", &Pair::b));
+  Pair p;
+  p.a = 2.5;
+  p.b = "x";
+  WrJsonContext wctx;
+  pairCodec.writeSize(wctx, p);
+  string out(wctx.size, 0);
+  wctx.s = &out[0];
+  pairCodec.write(wctx, p);
+  out.resize(wctx.s - &out[0]);
+  check(stringprintf("Pair writes keys in schema order: %s", out.c_str()).c_str(),
+        out == "{\"__type\":\"Pair\",\"b\":\"x\",\"a\":2.5}");
+
+  Pair q;
+  RdJsonContext rctx(out.c_str(), nullptr, false);
+  rctx.endStr = rctx.s + out.size();
+  check("Pair reads its own output on the fast path", pairCodec.readFast(rctx, q) && q.a == 2.5 && q.b == "x");
+
+  string declOrder = "{\"__type\":\"Pair\",\"a\":2.5,\"b\":\"x\"}";
+  RdJsonContext dctx(declOrder.c_str(), nullptr, false);
+  check("Pair declines keys in declaration order", !pairCodec.readFast(dctx, q) && dctx.s == declOrder.c_str());
+
+  // Field lists that don't match the schema
+  auto throws = [](std::function< void() > f) {
+    try {
+      f();
+    }
+    catch (runtime_error const &ex) {
+      return true;
+    }
+    return false;
+  };
+  check("missing field throws", throws([]() {
+    mkJsonFixedCodecFromSchema< Pair >(jsonFixedField("a", &Pair::a));
+  }));
+  check("misnamed field throws", throws([]() {
+    mkJsonFixedCodecFromSchema< Pair >(jsonFixedField("a", &Pair::a), jsonFixedField("c", &Pair::b));
+  }));
+  check("duplicate field throws", throws([]() {
+    mkJsonFixedCodecFromSchema< Pair >(jsonFixedField("a", &Pair::a), jsonFixedField("a", &Pair::a));
+  }));
+  check("unparsable schema throws", throws([]() {
+    JsonFixedCodec< Pair, JsonFixedField< Pair, double > >(jsonstr("{\"typename\":"), jsonFixedField("a", &Pair::a));
+  }));
+
+  return nFail ? 1 : 0;
+}
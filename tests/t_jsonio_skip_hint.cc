@@ -0,0 +1,71 @@
+/*
+  Round trips through maps with skip hints (see WrJsonContext::skipHintMin), including maps
+  with a real "__skip" key, which must not be mistaken for a hint.
+
+  Compile and run with (from the directory containing tlbcore, after building build.src):
+  $ g++ -std=c++14 -O2 -I. -Itlbcore -o t_jsonio_skip_hint tlbcore/tests/t_jsonio_skip_hint.cc tlbcore/common/jsonio.cc tlbcore/common/jsonio_parse.cc tlbcore/common/jsonio_types.cc tlbcore/common/ndarray_encoding.cc tlbcore/common/compress_parallel.cc tlbcore/common/parengine.cc tlbcore/common/chunk_file.cc tlbcore/common/hacks.cc -larmadillo -lz -lpthread && ./t_jsonio_skip_hint
+*/
+#include "tlbcore/common/std_headers.h"
+#include "tlbcore/common/jsonio.h"
+
+static int nFail;
+
+template<typename T>
+static void roundTrip(char const *desc, T const &a, size_t skipHintMin)
+{
+  jsonstr js;
+  toJson(js, a, skipHintMin);
+  T b;
+  string err;
+  if (!fromJson(js, b, err)) {
+    printf("FAIL %s: %s\n  %s\n", desc, err.c_str(), js.it.c_str());
+    nFail++;
+  }
+  else if (b != a) {
+    printf("FAIL %s: mismatch\n  %s\n", desc, js.it.c_str());
+    nFail++;
+  }
+  else {
+    printf("ok   %s\n", desc);
+  }
+}
+
+template<typename T>
+static void parse(char const *desc, string const &s, T const &expected)
+{
+  T b;
+  string err;
+  if (!fromJson(s, b, err)) {
+    printf("FAIL %s: %s\n", desc, err.c_str());
+    nFail++;
+  }
+  else if (b != expected) {
+    printf("FAIL %s: mismatch\n", desc);
+    nFail++;
+  }
+  else {
+    printf("ok   %s\n", desc);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  map< string, double > small {{"__skip", 5}, {"a", 1}};
+  map< string, double > big;
+  for (int i = 0; i < 100; i++) big["k" + to_string(i)] = i * 0.5;
+  big["__skip"] = 123;
+
+  roundTrip("__skip key, no hints", small, 0);
+  roundTrip("__skip key, small map with hints", small, 1);
+  roundTrip("__skip key, big map with hints", big, 1);
+  roundTrip("nested hinted maps", map< string, map< string, double > > {{"__skip", big}, {"x", small}}, 1);
+
+  parse("__skip with string value", "{\"__skip\":\"x\",\"a\":\"1\"}",
+    map< string, string > {{"__skip", "x"}, {"a", "1"}});
+  parse("__skip with numeric value", "{\"__skip\":5,\"a\":1}",
+    map< string, double > {{"__skip", 5}, {"a", 1}});
+  parse("__skip with padded numeric value", "{\"__skip\":25        ,\"a\":1}",
+    map< string, double > {{"__skip", 25}, {"a", 1}});
+
+  return nFail ? 1 : 0;
+}
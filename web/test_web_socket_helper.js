@@ -67,4 +67,59 @@ describe('RpcPendingQueue', function() {
     }
     assert.equal(pending.pendingCount, outstanding);
   });
+
+  it('should preserve on progress', function() {
+    let pending = new web_socket_helper.RpcPendingQueue();
+    let reqId = pending.getNewId();
+    pending.add(reqId, 'foo');
+    assert.strictEqual(pending.getPreserve(reqId), 'foo');
+    assert.strictEqual(pending.get(reqId), 'foo');
+    assert.strictEqual(pending.get(reqId), null);
+    assert.strictEqual(pending.getPreserve(reqId), null);
+    assert.equal(pending.pendingCount, 0);
+  });
+
+  it('should time out', function(done) {
+    let timedOut = [];
+    let pending = new web_socket_helper.RpcPendingQueue({
+      timeoutMs: 20,
+      onFail: (rspFunc, error) => { timedOut.push([rspFunc, error]); },
+    });
+    let id1 = pending.getNewId();
+    pending.add(id1, 'a');
+    let id2 = pending.getNewId();
+    pending.add(id2, 'b');
+    assert.strictEqual(pending.get(id1), 'a');
+    setTimeout(() => {
+      assert.deepEqual(timedOut, [['b', 'timeout']]);
+      assert.equal(pending.pendingCount, 0);
+      assert.equal(pending.stats.timedOut, 1);
+      assert.equal(pending.stats.completed, 1);
+      done();
+    }, 60);
+  });
+
+  it('should limit requests in flight', function() {
+    let pending = new web_socket_helper.RpcPendingQueue({maxInFlight: 2, maxQueued: 3});
+    let sent = [];
+    let errors = [];
+    for (let i=0; i<6; i++) {
+      pending.send((err) => { errors.push([i, err]); }, (rspId) => { sent.push(rspId); });
+    }
+    assert.equal(sent.length, 2);
+    assert.equal(pending.getWaitingCount(), 3);
+    assert.deepEqual(errors, [[5, 'overloaded']]);
+
+    // Each response lets one more go
+    pending.get(sent[0]);
+    assert.equal(sent.length, 3);
+    pending.get(sent[1]);
+    pending.get(sent[2]);
+    assert.equal(sent.length, 5);
+    assert.equal(pending.pendingCount, 2);
+    assert.equal(pending.getWaitingCount(), 0);
+    assert.equal(pending.stats.queued, 3);
+    assert.equal(pending.stats.rejected, 1);
+    assert.equal(pending.stats.maxPending, 2);
+  });
 });
@@ -14,7 +14,12 @@ exports.mkWebSocketClientRpc = mkWebSocketClientRpc;
 
 function mkWebSocketClientRpc(wscUrl, handlers) {
   let txQueue = [];
-  let pending = new web_socket_helper.RpcPendingQueue();
+  // handlers.rpcQueueOptions can set timeoutMs, maxInFlight and maxQueued. See RpcPendingQueue
+  let pending = new web_socket_helper.RpcPendingQueue(_.assign({
+    onFail: (cb, error) => {
+      cb.call(handlers, error);
+    },
+  }, handlers.rpcQueueOptions));
   let rxBinaries = [];
   let shutdownRequested = false;
   let interactivePending = null;
@@ -124,12 +129,12 @@ function mkWebSocketClientRpc(wscUrl, handlers) {
 
   function setupHandlers() {
     handlers.rpc = function(method, ...params) {
-      let id = pending.getNewId();
       let cb = params.pop();
       if (verbose >= 2) console.log('method=', method, 'params=', params);
 
-      pending.add(id, cb);
-      handlers.tx({method: method, id: id, params: params});
+      pending.send(cb, (id) => {
+        handlers.tx({method: method, id: id, params: params});
+      });
     };
     handlers.interactiveRpc = function(method, ...params) {
       let cb = params.pop();
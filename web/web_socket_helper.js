@@ -120,12 +120,30 @@ function parse(json, binaries) {
   Queue of outstanding RPC requests, indexed by ID. ID is an integer for now, but maybe it should be a hard-to-forge cookie.
   Especially coming from the server.
 
-  We use an array instead of a hash because I think it's faster.
+  A Map keeps them in the order they were added, with O(1) lookup. Options:
+    timeoutMs: fail requests with no final response after this long. One timer sweeps them all,
+      every sweepMs (default timeoutMs/4), so they time out up to sweepMs late.
+    maxInFlight: send() holds further requests in a queue until responses come back.
+    maxQueued: send() fails requests with 'overloaded' when this many are held.
+    onFail(rspFunc, error): how to fail a request, default rspFunc(error).
+  stats counts what happened, for monitoring.
 */
-function RpcPendingQueue() {
-  this.pending = [];
+function RpcPendingQueue(o) {
+  o = o || {};
+  this.pending = new Map();
   this.uniqueId = 567;
   this.pendingCount = 0;
+  this.timeoutMs = o.timeoutMs || 0;
+  this.sweepMs = o.sweepMs || Math.max(10, this.timeoutMs / 4);
+  this.onFail = o.onFail || ((rspFunc, error) => {
+    rspFunc(error);
+  });
+  this.maxInFlight = o.maxInFlight || Infinity;
+  this.maxQueued = o.maxQueued || Infinity;
+  this.waiting = [];
+  this.waitingHead = 0;
+  this.sweepTimer = null;
+  this.stats = {added: 0, completed: 0, timedOut: 0, queued: 0, rejected: 0, maxPending: 0};
 }
 
 RpcPendingQueue.prototype.getNewId = function() {
@@ -133,37 +151,96 @@ RpcPendingQueue.prototype.getNewId = function() {
 };
 
 RpcPendingQueue.prototype.get = function(rspId) {
-  for (let i=0; i<this.pending.length; i++) {
-    if (this.pending[i] && this.pending[i].rspId === rspId) {
-      let ret = this.pending[i].rspFunc;
-      this.pending[i] = null;
-      this.pendingCount --;
-      return ret;
-    }
-  }
-  return null;
+  let entry = this.pending.get(rspId);
+  if (!entry) return null;
+  this.pending.delete(rspId);
+  this.pendingCount --;
+  this.stats.completed ++;
+  this.sendWaiting();
+  return entry.rspFunc;
 };
 
 RpcPendingQueue.prototype.getPreserve = function(rspId) {
-  for (let i=0; i<this.pending.length; i++) {
-    if (this.pending[i] && this.pending[i].rspId === rspId) {
-      let ret = this.pending[i].rspFunc;
-      return ret;
-    }
-  }
-  return null;
+  let entry = this.pending.get(rspId);
+  if (!entry) return null;
+  return entry.rspFunc;
 };
 
 
 RpcPendingQueue.prototype.add = function(rspId, rspFunc) {
-  if (this.pending.length % 32 === 31) {
-    this.pending = _.filter(this.pending, function(x) { return x !== null; });
-  }
-  this.pending.push({rspId: rspId, rspFunc: rspFunc});
+  this.pending.set(rspId, {
+    rspFunc: rspFunc,
+    deadline: this.timeoutMs ? Date.now() + this.timeoutMs : 0,
+  });
   this.pendingCount ++;
-  if (this.pending.length % 50 === 0) {
-    console.log('! pending=' + this.pending.length);
+  this.stats.added ++;
+  this.stats.maxPending = Math.max(this.stats.maxPending, this.pendingCount);
+  if (this.timeoutMs && !this.sweepTimer) this.startSweep();
+};
+
+/*
+  Add a request and call txFunc(rspId) to send it, now or once there's room under maxInFlight.
+*/
+RpcPendingQueue.prototype.send = function(rspFunc, txFunc) {
+  if (this.pendingCount < this.maxInFlight && this.waitingHead === this.waiting.length) {
+    let rspId = this.getNewId();
+    this.add(rspId, rspFunc);
+    txFunc(rspId);
+    return;
+  }
+  if (this.waiting.length - this.waitingHead >= this.maxQueued) {
+    this.stats.rejected ++;
+    this.onFail(rspFunc, 'overloaded');
+    return;
+  }
+  this.stats.queued ++;
+  this.waiting.push({rspFunc, txFunc});
+};
+
+RpcPendingQueue.prototype.getWaitingCount = function() {
+  return this.waiting.length - this.waitingHead;
+};
+
+RpcPendingQueue.prototype.sendWaiting = function() {
+  while (this.waitingHead < this.waiting.length && this.pendingCount < this.maxInFlight) {
+    let w = this.waiting[this.waitingHead];
+    this.waiting[this.waitingHead++] = undefined;
+    let rspId = this.getNewId();
+    this.add(rspId, w.rspFunc);
+    w.txFunc(rspId);
+  }
+  if (this.waitingHead === this.waiting.length) {
+    this.waiting = [];
+    this.waitingHead = 0;
+  }
+  else if (this.waitingHead > 1024 && this.waitingHead * 2 > this.waiting.length) {
+    this.waiting = this.waiting.slice(this.waitingHead);
+    this.waitingHead = 0;
+  }
+};
+
+RpcPendingQueue.prototype.startSweep = function() {
+  this.sweepTimer = setTimeout(() => {
+    this.sweepTimer = null;
+    this.sweep(Date.now());
+    if (this.pendingCount > 0) this.startSweep();
+  }, this.sweepMs);
+  // Don't keep node running just for this
+  if (this.sweepTimer.unref) this.sweepTimer.unref();
+};
+
+RpcPendingQueue.prototype.sweep = function(now) {
+  let expired = [];
+  for (let [rspId, entry] of this.pending) {
+    if (entry.deadline && entry.deadline <= now) expired.push([rspId, entry.rspFunc]);
+  }
+  for (let [rspId, rspFunc] of expired) {
+    this.pending.delete(rspId);
+    this.pendingCount --;
+    this.stats.timedOut ++;
+    this.onFail(rspFunc, 'timeout');
   }
+  if (expired.length) this.sendWaiting();
 };
 
 function isRpcProgressError(error) {
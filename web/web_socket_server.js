@@ -37,7 +37,12 @@ exports.mkWebSocketRpc = mkWebSocketRpc;
 
 
 function mkWebSocketRpc(wsr, wsc, handlers) {
-  let pending = new web_socket_helper.RpcPendingQueue();
+  // handlers.rpcQueueOptions can set timeoutMs, maxInFlight and maxQueued. See RpcPendingQueue
+  let pending = new web_socket_helper.RpcPendingQueue(_.assign({
+    onFail: (cb, error) => {
+      cb.call(handlers, error);
+    },
+  }, handlers.rpcQueueOptions));
   let rxBinaries = [];
 
   setupHandlers();
@@ -120,10 +125,10 @@ function mkWebSocketRpc(wsr, wsc, handlers) {
   function setupHandlers() {
     handlers.remoteLabel = handlers.label = wsr.remoteLabel;
     handlers.rpc = function(method, ...params) {
-      let id = pending.getNewId();
       let cb = params.pop();
-      pending.add(id, cb);
-      handlers.tx({method: method, id: id, params: params});
+      pending.send(cb, (id) => {
+        handlers.tx({method: method, id: id, params: params});
+      });
     };
     handlers.tx = function(msg) {
       emitMsg(msg);